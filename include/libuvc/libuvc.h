@@ -87,6 +87,8 @@ enum uvc_frame_format {
   UVC_FRAME_FORMAT_SBGGR8,
   /** YUV420: NV12 */
   UVC_FRAME_FORMAT_NV12,
+  /** YUV420: I420, planar Y then U then V */
+  UVC_FRAME_FORMAT_I420,
   /** Number of formats understood */
   UVC_FRAME_FORMAT_COUNT,
 };
@@ -569,6 +571,23 @@ typedef struct uvc_device_descriptor {
   }
 } uvc_device_descriptor_t;
 
+/** An H.264 NAL unit within a frame, see UVC_STREAM_FLAG_H264_INDEX
+ * @ingroup streaming
+ */
+typedef struct uvc_nal_unit {
+  /** Offset of the NAL header byte in the frame data, just past the start code */
+  size_t offset;
+  /** Bytes from the header byte to the next start code or the end of the frame */
+  size_t size;
+  /** nal_unit_type: 1 for a non-IDR slice, 5 for an IDR slice, 7 for an SPS, 8 for a PPS... */
+  uint8_t type;
+} uvc_nal_unit_t;
+
+/** Alignment in bytes of frame data the library allocates
+ * @ingroup frame
+ */
+#define UVC_FRAME_DATA_ALIGN 64
+
 /** An image frame received from the UVC device
  * @ingroup streaming
  */
@@ -583,7 +602,11 @@ typedef struct uvc_frame {
   uint32_t height;
   /** Pixel data format */
   enum uvc_frame_format frame_format;
-  /** Number of bytes per horizontal line (undefined for compressed format) */
+  /** Number of bytes per horizontal line (undefined for compressed format).
+   * Zero on an input frame means packed lines. For planar formats this is
+   * the Y plane's; the NV12 UV plane's is the same rounded up to even, and
+   * the I420 U and V planes' half of it rounded up. Each plane starts right
+   * after the whole lines of the one before. */
   size_t step;
   /** Frame number (may skip, but is strictly monotonically increasing) */
   uint32_t sequence;
@@ -598,13 +621,21 @@ typedef struct uvc_frame {
    * If 1, the data buffer can be arbitrarily reallocated by frame conversion
    * functions.
    * If 0, the data buffer will not be reallocated or freed by the library.
-   * Set this field to zero if you are supplying the buffer.
+   * Set this field to zero if you are supplying the buffer. Conversion
+   * functions then write lines @ref step bytes apart if it is set, which
+   * lets them fill padded or sub-rectangle buffers directly.
    */
   uint8_t library_owns_data;
   /** Metadata for this frame if available */
   void *metadata;
   /** Size of metadata buffer */
   size_t metadata_bytes;
+  /** NAL units of an H.264 frame, in order, if the stream indexes them */
+  uvc_nal_unit_t *nal_units;
+  /** Number of entries in nal_units */
+  size_t num_nal_units;
+  /** Set if the frame holds an IDR slice, i.e. decoding can start here */
+  uint8_t key_frame;
 
   uvc_frame()
     : data(nullptr)
@@ -619,7 +650,10 @@ typedef struct uvc_frame {
     , source(nullptr)
     , library_owns_data(0)
     , metadata(nullptr)
-    , metadata_bytes(0) {
+    , metadata_bytes(0)
+    , nal_units(nullptr)
+    , num_nal_units(0)
+    , key_frame(0) {
   }
 } uvc_frame_t;
 
@@ -628,6 +662,132 @@ typedef struct uvc_frame {
  */
 typedef void(uvc_frame_callback_t)(struct uvc_frame *frame, void *user_ptr);
 
+/** A callback function to handle part of a frame while it is still arriving
+ * @ingroup streaming
+ *
+ * @p frame holds the data_bytes of the frame received so far; those from
+ * @p offset on are new since the last call. See
+ * uvc_stream_set_slice_callback().
+ */
+typedef void(uvc_slice_callback_t)(struct uvc_frame *frame, size_t offset, void *user_ptr);
+
+/** Stream setup flags, passed to uvc_stream_start() or uvc_start_streaming()
+ * @ingroup streaming
+ *
+ * The lowest bit is reserved for backward compatibility.
+ */
+enum uvc_stream_flags {
+  /** Hand out frames that point directly at the stream's frame buffers
+   * instead of copying each frame into a separate buffer. Every frame
+   * delivered to the callback or returned by uvc_stream_get_frame() must be
+   * given back with uvc_stream_release_frame().
+   */
+  UVC_STREAM_FLAG_ZERO_COPY = (1 << 1),
+  /** Check each completed MJPEG frame's marker structure (see
+   * uvc_mjpeg_validate()) and drop frames that are truncated or corrupt
+   * instead of delivering them. Ignored for other formats.
+   */
+  UVC_STREAM_FLAG_DROP_CORRUPT = (1 << 2),
+  /** Split each H.264 frame into NAL units while it is assembled, filling
+   * in uvc_frame::nal_units and uvc_frame::key_frame. Ignored for other
+   * formats.
+   */
+  UVC_STREAM_FLAG_H264_INDEX = (1 << 3),
+  /** Call the frame callback directly from the thread that completes each
+   * frame, the libusb event thread or a replay's thread, rather than waking
+   * a separate callback thread. This saves a context switch per frame for
+   * latency-critical consumers, at the price of the constraints listed
+   * under uvc_stream_start(). Cannot be combined with
+   * UVC_STREAM_FLAG_ZERO_COPY or uvc_stream_set_decode().
+   */
+  UVC_STREAM_FLAG_INLINE_CALLBACK = (1 << 4)
+};
+
+/** Options for uvc_stream_open_replay()
+ * @ingroup replay
+ */
+enum uvc_replay_flags {
+  /** Deliver transfers at the pace they were captured instead of as fast as
+   * possible */
+  UVC_REPLAY_FLAG_REALTIME = (1 << 0),
+  /** Start over at the end of the capture until the stream is stopped */
+  UVC_REPLAY_FLAG_LOOP = (1 << 1)
+};
+
+/** Resampling filters for uvc_yuv422_convert_resized()
+ * @ingroup frame
+ */
+enum uvc_resize_filter {
+  /** Take the nearest source pixel */
+  UVC_RESIZE_NEAREST = 0,
+  /** Interpolate between the 2x2 nearest source pixels */
+  UVC_RESIZE_BILINEAR = 1
+};
+
+/** Number of buckets in the latency histograms of uvc_stream_stats */
+#define UVC_STREAM_STATS_HISTOGRAM_BUCKETS 24
+
+/** Counters describing the health of a stream, see uvc_stream_get_stats()
+ * @ingroup streaming
+ *
+ * All counters are cumulative since the stream was opened. Latency
+ * histograms are base 2: bucket 0 counts latencies below 1 us, bucket i
+ * latencies in [2^(i-1), 2^i) us, and the last bucket everything longer.
+ */
+typedef struct uvc_stream_stats {
+  /** Frames completed by the transfer callback (EOF or FID change) */
+  uint64_t frames_completed;
+  /** Frames handed to the user callback or returned by uvc_stream_get_frame() */
+  uint64_t frames_delivered;
+  /** Completed frames discarded because every frame buffer was in use */
+  uint64_t frames_dropped;
+  /** Frames ended by a FID change because the device sent no EOF */
+  uint64_t fid_resyncs;
+  /** Payloads discarded because their header had the error bit set */
+  uint64_t error_packets;
+  /** Payloads discarded because their header length exceeded the payload */
+  uint64_t bogus_header_packets;
+  /** Isochronous packets that completed with a non-zero status */
+  uint64_t iso_packet_errors;
+  /** Transfers that completed with an error, stall, timeout or overflow */
+  uint64_t transfer_errors;
+  /** Transfers that could not be resubmitted */
+  uint64_t resubmit_failures;
+  /** Image bytes received */
+  uint64_t payload_bytes;
+  /** Header metadata bytes received */
+  uint64_t metadata_bytes;
+  /** Frames the decode stage could not decode (see uvc_stream_set_decode()) */
+  uint64_t decode_errors;
+  /** MJPEG frames dropped as corrupt (see UVC_STREAM_FLAG_DROP_CORRUPT) */
+  uint64_t corrupt_frames;
+  /** Frames dropped because a payload could not be stored for lack of memory */
+  uint64_t incomplete_frames;
+  /** Time from a frame's first payload to its completion */
+  uint64_t assembly_latency_hist[UVC_STREAM_STATS_HISTOGRAM_BUCKETS];
+  /** Time from a frame's completion to its delivery to the user */
+  uint64_t callback_latency_hist[UVC_STREAM_STATS_HISTOGRAM_BUCKETS];
+
+  uvc_stream_stats()
+    : frames_completed(0)
+    , frames_delivered(0)
+    , frames_dropped(0)
+    , fid_resyncs(0)
+    , error_packets(0)
+    , bogus_header_packets(0)
+    , iso_packet_errors(0)
+    , transfer_errors(0)
+    , resubmit_failures(0)
+    , payload_bytes(0)
+    , metadata_bytes(0)
+    , decode_errors(0)
+    , corrupt_frames(0)
+    , incomplete_frames(0)
+    , assembly_latency_hist()
+    , callback_latency_hist() {
+  }
+} uvc_stream_stats_t;
+
 /** Streaming mode, includes all information needed to select stream
  * @ingroup streaming
  */
@@ -696,6 +856,7 @@ typedef struct uvc_still_ctrl {
 
 uvc_error_t uvc_init(uvc_context_t **ctx, struct libusb_context *usb_ctx);
 void uvc_exit(uvc_context_t *ctx);
+uvc_error_t uvc_set_conversion_threads(uvc_context_t *ctx, int num_threads);
 
 uvc_error_t uvc_get_device_list(
     uvc_context_t *ctx,
@@ -793,6 +954,7 @@ void uvc_stop_streaming(uvc_device_handle_t *devh);
 void uvc_stream_set_default_number_of_transport_buffers(size_t s);
 void uvc_stream_set_default_size_of_transport_buffer(size_t s);
 void uvc_stream_set_default_size_of_meta_transport_buffer(size_t s);
+void uvc_stream_set_default_number_of_frame_buffers(size_t s);
 
 uvc_error_t uvc_stream_open_ctrl(uvc_device_handle_t *devh, uvc_stream_handle_t **strmh, uvc_stream_ctrl_t *ctrl);
 uvc_error_t uvc_stream_ctrl(uvc_stream_handle_t *strmh, uvc_stream_ctrl_t *ctrl);
@@ -808,9 +970,17 @@ uvc_error_t uvc_stream_get_frame(
     uvc_frame_t **frame,
     int32_t timeout_us
 );
+uvc_error_t uvc_stream_release_frame(uvc_stream_handle_t *strmh, uvc_frame_t *frame);
+uvc_error_t uvc_stream_set_slice_callback(uvc_stream_handle_t *strmh,
+    uvc_slice_callback_t *cb, void *user_ptr, size_t slice_bytes);
+uvc_error_t uvc_stream_get_stats(uvc_stream_handle_t *strmh, uvc_stream_stats_t *stats);
 uvc_error_t uvc_stream_stop(uvc_stream_handle_t *strmh);
 void uvc_stream_close(uvc_stream_handle_t *strmh);
 
+uvc_error_t uvc_stream_start_capture(uvc_stream_handle_t *strmh, const char *path);
+uvc_error_t uvc_stream_stop_capture(uvc_stream_handle_t *strmh);
+uvc_error_t uvc_stream_open_replay(const char *path, uint8_t flags, uvc_stream_handle_t **strmh);
+
 int uvc_get_ctrl_len(uvc_device_handle_t *devh, uint8_t unit, uint8_t ctrl);
 int uvc_get_ctrl(uvc_device_handle_t *devh, uint8_t unit, uint8_t ctrl, void *data, int len, enum uvc_req_code req_code);
 int uvc_set_ctrl(uvc_device_handle_t *devh, uint8_t unit, uint8_t ctrl, void *data, int len);
@@ -957,13 +1127,46 @@ uvc_error_t uvc_any2rgb(uvc_frame_t *in, uvc_frame_t *out);
 uvc_error_t uvc_yuyv2bgr(uvc_frame_t *in, uvc_frame_t *out);
 uvc_error_t uvc_uyvy2bgr(uvc_frame_t *in, uvc_frame_t *out);
 uvc_error_t uvc_any2bgr(uvc_frame_t *in, uvc_frame_t *out);
+uvc_error_t uvc_convert(uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format format);
+uvc_error_t uvc_yuv422_convert_resized(uvc_frame_t *in, uvc_frame_t *out,
+    enum uvc_frame_format format, int width, int height, enum uvc_resize_filter filter);
 
 uvc_error_t uvc_yuyv2y(uvc_frame_t *in, uvc_frame_t *out);
 uvc_error_t uvc_yuyv2uv(uvc_frame_t *in, uvc_frame_t *out);
+uvc_error_t uvc_yuyv2i420(uvc_frame_t *in, uvc_frame_t *out);
+uvc_error_t uvc_yuyv2nv12(uvc_frame_t *in, uvc_frame_t *out);
+uvc_error_t uvc_uyvy2i420(uvc_frame_t *in, uvc_frame_t *out);
+uvc_error_t uvc_uyvy2nv12(uvc_frame_t *in, uvc_frame_t *out);
+
+uvc_error_t uvc_nv122rgb(uvc_frame_t *in, uvc_frame_t *out);
+uvc_error_t uvc_nv122bgr(uvc_frame_t *in, uvc_frame_t *out);
+uvc_error_t uvc_gray162gray(uvc_frame_t *in, uvc_frame_t *out, int shift, uint16_t offset);
+uvc_error_t uvc_bayer2rgb(uvc_frame_t *in, uvc_frame_t *out);
+uvc_error_t uvc_bayer2bgr(uvc_frame_t *in, uvc_frame_t *out);
+
+uvc_error_t uvc_mjpeg_validate(uvc_frame_t *frame);
 
 #ifdef LIBUVC_HAS_JPEG
 uvc_error_t uvc_mjpeg2rgb(uvc_frame_t *in, uvc_frame_t *out);
 uvc_error_t uvc_mjpeg2gray(uvc_frame_t *in, uvc_frame_t *out);
+uvc_error_t uvc_mjpeg2i420(uvc_frame_t *in, uvc_frame_t *out);
+uvc_error_t uvc_mjpeg2nv12(uvc_frame_t *in, uvc_frame_t *out);
+
+typedef struct uvc_mjpeg_decoder uvc_mjpeg_decoder_t;
+uvc_error_t uvc_mjpeg_decoder_create(uvc_mjpeg_decoder_t **decoder);
+void uvc_mjpeg_decoder_destroy(uvc_mjpeg_decoder_t *decoder);
+uvc_error_t uvc_mjpeg_decode(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *in,
+    uvc_frame_t *out, enum uvc_frame_format format);
+uvc_error_t uvc_mjpeg_decode_scaled(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *in,
+    uvc_frame_t *out, enum uvc_frame_format format, int scale_denom);
+uvc_error_t uvc_mjpeg_decode_buffer(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *in,
+    void *data, size_t data_bytes, size_t step, enum uvc_frame_format format);
+uvc_error_t uvc_mjpeg_decode_roi(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *in,
+    uvc_frame_t *out, enum uvc_frame_format format,
+    int x, int y, int width, int height);
+
+uvc_error_t uvc_stream_set_decode(uvc_stream_handle_t *strmh,
+    enum uvc_frame_format format, int num_threads);
 #endif
 
 #ifdef __cplusplus
@@ -8,8 +8,10 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -215,6 +217,7 @@ struct uvc_stream_config_t {
   size_t number_of_transport_buffers;
   size_t size_of_transport_buffer;
   size_t size_of_meta_transport_buffer;
+  size_t number_of_frame_buffers;
 };
 
 extern uvc_stream_config_t uvc_stream_config;
@@ -228,6 +231,337 @@ struct libusb_transfer_deleter {
 
 typedef std::unique_ptr<struct libusb_transfer, struct libusb_transfer_deleter> unique_ptr_libusb_transfer;
 
+/** Bounded lock-free queue (multiple producers, multiple consumers)
+ *
+ * Each cell carries a sequence number that tells producers and consumers
+ * whether it is free or full for the current lap around the ring, so push()
+ * and pop() only need one compare-and-swap and never allocate.
+ */
+template <typename T>
+struct uvc_bounded_queue {
+  struct cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<cell[]> cells;
+  size_t mask;
+  std::atomic<size_t> enqueue_pos;
+  std::atomic<size_t> dequeue_pos;
+
+  uvc_bounded_queue()
+    : mask(0)
+    , enqueue_pos(0)
+    , dequeue_pos(0) {
+  }
+
+  /** Drop all entries and make room for at least capacity of them.
+   * Must not run concurrently with push() or pop(). */
+  void reset(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+
+    cells.reset(new cell[size]);
+    for (size_t i = 0; i < size; ++i)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    mask = size - 1;
+    enqueue_pos.store(0, std::memory_order_relaxed);
+    dequeue_pos.store(0, std::memory_order_relaxed);
+  }
+
+  /** @return false if the queue is full */
+  bool push(T value) {
+    cell *c;
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+
+    for (;;) {
+      c = &cells[pos & mask];
+      size_t seq = c->sequence.load(std::memory_order_acquire);
+      intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+
+      if (dif == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+
+    c->value = value;
+    c->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** @return false if the queue is empty */
+  bool pop(T *value) {
+    cell *c;
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+
+    for (;;) {
+      c = &cells[pos & mask];
+      size_t seq = c->sequence.load(std::memory_order_acquire);
+      intptr_t dif = (intptr_t) seq - (intptr_t) (pos + 1);
+
+      if (dif == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+
+    *value = c->value;
+    c->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** Snapshot; only exact when no push() or pop() is in flight */
+  bool empty() const {
+    return dequeue_pos.load(std::memory_order_acquire) ==
+      enqueue_pos.load(std::memory_order_acquire);
+  }
+};
+
+/** Bounded lock-free queue for exactly one producer and one consumer thread
+ *
+ * Cheaper than uvc_bounded_queue: push() and pop() are a load and a store
+ * each, with no read-modify-write.
+ */
+template <typename T>
+struct uvc_spsc_queue {
+  std::unique_ptr<T[]> items;
+  size_t mask;
+  /** Next slot to pop; written by the consumer only */
+  std::atomic<size_t> head;
+  /* keep head and tail on separate cache lines */
+  uint8_t pad[64];
+  /** Next slot to push; written by the producer only */
+  std::atomic<size_t> tail;
+
+  uvc_spsc_queue()
+    : mask(0)
+    , head(0)
+    , tail(0) {
+  }
+
+  /** Drop all entries and make room for at least capacity of them.
+   * Must not run concurrently with push() or pop(). */
+  void reset(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+
+    items.reset(new T[size]);
+    mask = size - 1;
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+  }
+
+  /** @return false if the queue is full */
+  bool push(T value) {
+    size_t t = tail.load(std::memory_order_relaxed);
+
+    if (t - head.load(std::memory_order_acquire) > mask)
+      return false;
+
+    items[t & mask] = value;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** @return false if the queue is empty */
+  bool pop(T *value) {
+    size_t h = head.load(std::memory_order_relaxed);
+
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+
+    *value = items[h & mask];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return head.load(std::memory_order_acquire) ==
+      tail.load(std::memory_order_acquire);
+  }
+};
+
+/** One slot of a stream's frame buffer pool
+ *
+ * The transfer callback assembles a frame into the stream's current slot.
+ * On EOF the slot is pushed onto the ready queue and a fresh slot is taken
+ * from the free list. Consumers pop ready slots, and in zero-copy mode hand
+ * out frame (pointing into buf) until uvc_stream_release_frame() puts the
+ * slot back on the free list.
+ *
+ * buf is malloc()ed so it can be exchanged with a bulk transfer's buffer:
+ * when a single transfer carries a whole frame, the transfer's buffer becomes
+ * the slot's storage (the image starting after the payload header, at
+ * data_offset) and the slot's old storage is resubmitted in its place.
+ */
+struct uvc_frame_buffer {
+  /** Frame handed to the user in zero-copy mode */
+  struct uvc_frame frame;
+  /** Image storage of buf_size bytes; the image is the got_bytes starting at data_offset */
+  uint8_t *buf;
+  size_t buf_size;
+  size_t data_offset;
+  size_t got_bytes;
+  /** Header metadata storage; only the first meta_got_bytes are valid */
+  uint8_t *meta_buf;
+  size_t meta_buf_size;
+  size_t meta_got_bytes;
+  uint32_t seq;
+  uint32_t pts;
+  uint32_t last_scr;
+  /** When the first payload of the frame arrived */
+  std::chrono::steady_clock::time_point capture_time_started;
+  std::chrono::steady_clock::time_point capture_time_finished;
+  /** Set while the slot is lent to the user in zero-copy mode */
+  std::atomic<uint8_t> lent;
+  /** H.264 NAL units found so far, with UVC_STREAM_FLAG_H264_INDEX */
+  std::vector<uvc_nal_unit_t> nal_units;
+  /** Where the search for the next start code resumes */
+  size_t nal_scan_pos;
+  uint8_t key_frame;
+  /** Set when a payload could not be stored; the frame is dropped at its end */
+  uint8_t incomplete;
+
+  uvc_frame_buffer()
+    : buf(nullptr)
+    , buf_size(0)
+    , data_offset(0)
+    , got_bytes(0)
+    , meta_buf(nullptr)
+    , meta_buf_size(0)
+    , meta_got_bytes(0)
+    , seq(0)
+    , pts(0)
+    , last_scr(0)
+    //, capture_time_started default constructed
+    //, capture_time_finished default constructed
+    , lent(0)
+    , nal_scan_pos(0)
+    , key_frame(0)
+    , incomplete(0) {
+  }
+
+  ~uvc_frame_buffer() {
+    free(buf);
+    free(meta_buf);
+  }
+};
+
+/** Counters behind uvc_stream_get_stats()
+ *
+ * Updated with relaxed atomic adds from the transfer callback and the
+ * consumer, so they are cheap enough to keep enabled. A reader gets each
+ * counter exactly, but not a consistent snapshot across counters.
+ */
+struct uvc_stream_counters {
+  std::atomic<uint64_t> frames_completed;
+  std::atomic<uint64_t> frames_delivered;
+  std::atomic<uint64_t> frames_dropped;
+  std::atomic<uint64_t> fid_resyncs;
+  std::atomic<uint64_t> error_packets;
+  std::atomic<uint64_t> bogus_header_packets;
+  std::atomic<uint64_t> iso_packet_errors;
+  std::atomic<uint64_t> transfer_errors;
+  std::atomic<uint64_t> resubmit_failures;
+  std::atomic<uint64_t> payload_bytes;
+  std::atomic<uint64_t> metadata_bytes;
+  std::atomic<uint64_t> decode_errors;
+  std::atomic<uint64_t> corrupt_frames;
+  std::atomic<uint64_t> incomplete_frames;
+  std::atomic<uint64_t> assembly_latency_hist[UVC_STREAM_STATS_HISTOGRAM_BUCKETS];
+  std::atomic<uint64_t> callback_latency_hist[UVC_STREAM_STATS_HISTOGRAM_BUCKETS];
+
+  uvc_stream_counters()
+    : frames_completed(0)
+    , frames_delivered(0)
+    , frames_dropped(0)
+    , fid_resyncs(0)
+    , error_packets(0)
+    , bogus_header_packets(0)
+    , iso_packet_errors(0)
+    , transfer_errors(0)
+    , resubmit_failures(0)
+    , payload_bytes(0)
+    , metadata_bytes(0)
+    , decode_errors(0)
+    , corrupt_frames(0)
+    , incomplete_frames(0) {
+    for (int i = 0; i < UVC_STREAM_STATS_HISTOGRAM_BUCKETS; ++i) {
+      assembly_latency_hist[i].store(0, std::memory_order_relaxed);
+      callback_latency_hist[i].store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
+/** Bump a stream counter; ordering with other memory is not needed */
+static inline void _uvc_count(std::atomic<uint64_t> *counter, uint64_t n = 1) {
+  counter->fetch_add(n, std::memory_order_relaxed);
+}
+
+/** @name Capture file format
+ *
+ * A capture file (see uvc_stream_start_capture()) is a
+ * uvc_capture_file_header followed by one uvc_capture_record per completed
+ * transfer. A record is followed by num_iso_packets uvc_capture_iso_packet
+ * descriptors and then the transfer's data: the whole payload for a bulk
+ * transfer, or each iso packet's actual bytes back to back. Records are padded
+ * to a multiple of 8 bytes so a mapped file can be walked in place. Fields are
+ * in host byte order; the magic identifies files from a host of the other
+ * byte order.
+ */
+/** @{ */
+#define UVC_CAPTURE_MAGIC "UVCCAPT1"
+#define UVC_CAPTURE_VERSION 1
+
+struct uvc_capture_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_bytes;
+  /** Format of the stream, as in uvc_format_desc */
+  uint8_t guidFormat[16];
+  uint8_t bDescriptorSubtype;
+  uint8_t is_isight;
+  uint16_t wWidth;
+  uint16_t wHeight;
+  uint16_t reserved0;
+  uint32_t dwFrameInterval;
+  uint32_t dwMaxVideoFrameSize;
+  uint32_t dwMaxPayloadTransferSize;
+  uint32_t reserved1[3];
+};
+
+struct uvc_capture_record {
+  /** Completion time relative to the start of the capture */
+  uint64_t timestamp_ns;
+  /** Size of this record including its header, descriptors, data and padding */
+  uint32_t record_bytes;
+  /** enum libusb_transfer_status */
+  int32_t status;
+  uint32_t num_iso_packets;
+  uint32_t data_bytes;
+};
+
+struct uvc_capture_iso_packet {
+  uint32_t actual_length;
+  int32_t status;
+};
+/** @} */
+
+struct uvc_capture;
+struct uvc_replay;
+struct uvc_decode_stage;
+
 struct uvc_stream_handle {
   struct uvc_device_handle *devh;
   struct uvc_stream_handle *prev, *next;
@@ -238,28 +572,48 @@ struct uvc_stream_handle {
   /** Current control block */
   struct uvc_stream_ctrl cur_ctrl;
 
-  /* listeners may only access hold*, and only when holding a
-   * lock on cb_mutex (probably signaled with cb_cond)
+  /* The struct libusb_transfer* callback (_uvc_stream_callback) copies bytes
+   * into cur_buf, a slot from the frame buffer pool. When cur_buf contains a
+   * full frame (determined by EOF bit), it is pushed onto ready_bufs, a new
+   * slot is popped from free_bufs and the consumer is woken if it is waiting.
+   * The _uvc_user_caller() thread (or a poller) pops the frame, calls the
+   * user's callback function with it and returns the slot to free_bufs. If no
+   * slot is free the finished frame is dropped and its slot reused.
    *
-   * The struct libusb_transfer* callback (_uvc_stream_callback) copies bytes
-   * to uint8_t *outbuf. When outbuf contains a full frame (determined by EOF
-   * bit), the contents of oubuf are copied to uint8_t *holdbuf and
-   * callback_cond is notified. The waiting _uvc_user_caller() thread then
-   * calls the user's callback function with the completed frame.
+   * Only the transfer callback touches cur_buf, and it is the only producer
+   * of ready_bufs; there is one consumer. Neither side takes callback_mutex
+   * per frame: the consumer announces itself in frame_waiters before it
+   * sleeps on callback_cond, and the producer only locks and notifies when
+   * it sees a waiter.
    */
   
   uint8_t fid;
-  uint32_t seq, hold_seq;
-  uint32_t pts, hold_pts;
-  uint32_t last_scr, hold_last_scr;
-  std::vector<uint8_t> outbuf;
-  std::vector<uint8_t> holdbuf;
+  uint32_t seq;
+  uint32_t pts;
+  uint32_t last_scr;
+  std::vector<std::unique_ptr<struct uvc_frame_buffer> > frame_buffers;
+  struct uvc_frame_buffer *cur_buf;
+  uvc_bounded_queue<struct uvc_frame_buffer *> free_bufs;
+  uvc_spsc_queue<struct uvc_frame_buffer *> ready_bufs;
   std::mutex callback_mutex;
   std::condition_variable callback_cond;
+  std::atomic<int> frame_waiters;
   std::thread callback_thread;
-  uint32_t last_polled_seq;
   uvc_frame_callback_t *user_cb;
   void *user_ptr;
+  /** Flags passed to uvc_stream_start (see enum uvc_stream_flags) */
+  uint8_t flags;
+  /** Sees cur_buf every slice_bytes (see uvc_stream_set_slice_callback) */
+  uvc_slice_callback_t *slice_cb;
+  void *slice_user_ptr;
+  size_t slice_bytes;
+  /** Bytes of cur_buf already passed to slice_cb */
+  size_t slice_done;
+  struct uvc_stream_counters counters;
+  /** Transfers are recorded here while set (see uvc_stream_start_capture) */
+  struct uvc_capture *capture;
+  /** Set if payloads come from a capture file instead of a device */
+  struct uvc_replay *replay;
   /*
    * Each transfer is a unique_ptr<libusb_transfer> whose underlying raw pointer
    * is managed by libusb_alloc_transfer/libusb_free_transfer. The
@@ -269,10 +623,12 @@ struct uvc_stream_handle {
   std::vector<std::unique_ptr<struct libusb_transfer, libusb_transfer_deleter> > transfers;
   struct uvc_frame frame;
   enum uvc_frame_format frame_format;
-  std::chrono::steady_clock::time_point capture_time_finished;
-  /* raw metadata buffer if available */
-  std::vector<uint8_t> meta_outbuf;
-  std::vector<uint8_t> meta_holdbuf;
+  /** Output format of the decode stage, UVC_FRAME_FORMAT_UNKNOWN if
+   * frames are delivered as received (see uvc_stream_set_decode) */
+  enum uvc_frame_format decode_format;
+  int decode_threads;
+  /** Set while the decode stage is running */
+  struct uvc_decode_stage *decode;
 
   uvc_stream_handle()
     : devh(nullptr)
@@ -283,24 +639,27 @@ struct uvc_stream_handle {
     //, cur_ctrl default constructed
     , fid(0)
     , seq(0)
-    , hold_seq(0)
     , pts(0)
-    , hold_pts(0)
     , last_scr(0)
-    , hold_last_scr(0)
-    , last_polled_seq(0)
+    , cur_buf(nullptr)
+    , frame_waiters(0)
     , user_cb(nullptr)
     , user_ptr(nullptr)
+    , flags(0)
+    , slice_cb(nullptr)
+    , slice_user_ptr(nullptr)
+    , slice_bytes(0)
+    , slice_done(0)
+    //, counters default constructed
+    , capture(nullptr)
+    , replay(nullptr)
     , transfers(uvc_stream_config.number_of_transport_buffers)
     //, frame default constructed
     , frame_format(UVC_FRAME_FORMAT_UNKNOWN)
-    //, capture_time_finished default constructed
+    , decode_format(UVC_FRAME_FORMAT_UNKNOWN)
+    , decode_threads(0)
+    , decode(nullptr)
   {
-    /** @todo take only what we need */
-    outbuf.reserve(uvc_stream_config.size_of_transport_buffer);
-    holdbuf.reserve(uvc_stream_config.size_of_transport_buffer);
-    meta_outbuf.reserve(uvc_stream_config.size_of_meta_transport_buffer);
-    meta_holdbuf.reserve(uvc_stream_config.size_of_meta_transport_buffer);
   }
 
   ~uvc_stream_handle() {
@@ -357,6 +716,37 @@ struct uvc_device_handle {
   }
 };
 
+/** Workers that split one frame conversion into row stripes.
+ *
+ * A job is posted under mutex and its stripes are claimed one at a time
+ * under the same lock, so a worker never runs a stripe of a job that has
+ * already finished. The posting thread claims stripes too. run_mutex
+ * admits one job at a time; a conversion that finds it taken runs on
+ * its own thread instead of queueing behind another stream's frame.
+ */
+struct uvc_conv_pool {
+  std::vector<std::thread> threads;
+  std::mutex run_mutex;
+  std::mutex mutex;
+  std::condition_variable work_cond;
+  std::condition_variable done_cond;
+  void (*fn)(void *arg, int stripe, int num_stripes);
+  void *arg;
+  int num_stripes;
+  int next_stripe;
+  int pending;
+  int stop;
+
+  uvc_conv_pool()
+    : fn(nullptr)
+    , arg(nullptr)
+    , num_stripes(0)
+    , next_stripe(0)
+    , pending(0)
+    , stop(0) {
+  }
+};
+
 /** Context within which we communicate with devices */
 struct uvc_context {
   /** Underlying context for USB communication */
@@ -367,13 +757,16 @@ struct uvc_context {
   uvc_device_handle_t *open_devices;
   std::thread handler_thread;
   int kill_handler_thread;
+  /** Conversion workers, see uvc_set_conversion_threads() */
+  struct uvc_conv_pool *conv_pool;
 
   uvc_context()
     : usb_ctx(nullptr)
     , own_usb_ctx(0)
     , open_devices(nullptr)
     //, handler_thread default constructed
-    , kill_handler_thread(0) {
+    , kill_handler_thread(0)
+    , conv_pool(nullptr) {
   }
 };
 
@@ -387,6 +780,78 @@ void uvc_start_handler_thread(uvc_context_t *ctx);
 uvc_error_t uvc_claim_if(uvc_device_handle_t *devh, int idx);
 uvc_error_t uvc_release_if(uvc_device_handle_t *devh, int idx);
 
+/** Instruction set levels for the conversion kernels, lowest first */
+enum uvc_simd_level {
+  UVC_SIMD_NONE = 0,
+  UVC_SIMD_SSSE3,
+  UVC_SIMD_AVX2,
+  UVC_SIMD_NEON,
+};
+
+/** Converts an even number of packed 4:2:2 pixels to packed 24-bit RGB/BGR */
+typedef void (*uvc_yuv422_rgb_fn)(const uint8_t *in, uint8_t *out, size_t pixels);
+/** Converts an even number of pixels of two packed 4:2:2 rows to their Y
+ * rows and one 4:2:0 chroma row, averaging each vertical pair of chroma
+ * samples. NV12 converters write U,V pairs to u and ignore v. */
+typedef void (*uvc_yuv422_420_fn)(const uint8_t *row0, const uint8_t *row1,
+    uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, size_t pixels);
+/** Copies the Y of packed 4:2:2 pixels to 8-bit gray */
+typedef void (*uvc_yuv422_y_fn)(const uint8_t *in, uint8_t *out, size_t pixels);
+/** Converts an even number of pixels of an NV12 Y row, with the U,V row
+ * that goes with it, to packed 24-bit RGB/BGR */
+typedef void (*uvc_nv12_rgb_fn)(const uint8_t *y, const uint8_t *uv, uint8_t *out, size_t pixels);
+/** Replicates 8-bit gray pixels into packed 24-bit pixels */
+typedef void (*uvc_gray_rgb_fn)(const uint8_t *in, uint8_t *out, size_t pixels);
+/** Converts 16-bit little-endian gray pixels to 8 bits as
+ * clamp((v - offset) >> shift, 0, 255) */
+typedef void (*uvc_gray16_fn)(const uint8_t *in, uint8_t *out, size_t pixels,
+    int shift, uint16_t offset);
+/** Demosaics a row of at least 2 pixels of an 8-bit Bayer image to packed
+ * 24-bit RGB/BGR, given the rows above and below it. Bit 0 of pattern is
+ * set if the row starts with green, bit 1 if its other colour is red. */
+typedef void (*uvc_bayer_rgb_fn)(const uint8_t *above, const uint8_t *row,
+    const uint8_t *below, uint8_t *out, size_t width, int pattern);
+
+void *_uvc_frame_data_alloc(size_t bytes);
+void _uvc_frame_data_free(void *data);
+size_t _uvc_out_step(const uvc_frame_t *out, size_t row_bytes);
+size_t _uvc_in_step(const uvc_frame_t *in, size_t row_bytes, size_t rows);
+size_t _uvc_chroma_step(enum uvc_frame_format format, size_t step);
+uvc_error_t _uvc_ensure_frame_rows(uvc_frame_t *out, size_t step, size_t row_bytes, size_t rows);
+
+struct uvc_conv_pool *_uvc_frame_conv_pool(uvc_frame_t *frame);
+int _uvc_conv_stripes(struct uvc_conv_pool *pool, int rows, int min_rows);
+void _uvc_conv_run(struct uvc_conv_pool *pool, int num_stripes,
+    void (*fn)(void *arg, int stripe, int num_stripes), void *arg);
+void _uvc_conv_pool_free(struct uvc_conv_pool *pool);
+
+enum uvc_simd_level _uvc_simd_level(void);
+uvc_yuv422_rgb_fn _uvc_get_yuv422_rgb(int uyvy, int bgr, enum uvc_simd_level level);
+uvc_yuv422_420_fn _uvc_get_yuv422_420(int uyvy, int nv12, enum uvc_simd_level level);
+uvc_yuv422_y_fn _uvc_get_yuv422_y(int uyvy, enum uvc_simd_level level);
+uvc_nv12_rgb_fn _uvc_get_nv12_rgb(int bgr, enum uvc_simd_level level);
+uvc_gray_rgb_fn _uvc_get_gray_rgb(enum uvc_simd_level level);
+uvc_gray16_fn _uvc_get_gray16(enum uvc_simd_level level);
+uvc_bayer_rgb_fn _uvc_get_bayer_rgb(int bgr, enum uvc_simd_level level);
+
+int _uvc_mjpeg_valid(const uint8_t *data, size_t data_bytes);
+
+uvc_error_t _uvc_stream_alloc_frame_buffers(uvc_stream_handle_t *strmh);
+void _uvc_process_payload(uvc_stream_handle_t *strmh, uint8_t *payload, size_t payload_len);
+void _uvc_process_bulk_transfer(uvc_stream_handle_t *strmh, struct libusb_transfer *transfer);
+void _uvc_capture_transfer(struct uvc_capture *capture, struct libusb_transfer *transfer);
+uvc_error_t _uvc_capture_close(struct uvc_capture *capture);
+uvc_error_t _uvc_replay_start(uvc_stream_handle_t *strmh);
+void _uvc_replay_stop(uvc_stream_handle_t *strmh);
+void _uvc_replay_close(uvc_stream_handle_t *strmh);
+void *_uvc_user_caller(void *arg);
+void _uvc_record_latency(std::atomic<uint64_t> *hist, std::chrono::steady_clock::duration d);
+void _uvc_populate_frame_info(uvc_stream_handle_t *strmh,
+    struct uvc_frame_buffer *fb, uvc_frame_t *frame);
+uvc_error_t _uvc_decode_start(uvc_stream_handle_t *strmh);
+void _uvc_decode_submit(uvc_stream_handle_t *strmh, struct uvc_frame_buffer *fb);
+void _uvc_decode_stop(uvc_stream_handle_t *strmh);
+
 #endif // !def(LIBUVC_INTERNAL_H)
 /** @endcond */
 
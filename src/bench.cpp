@@ -0,0 +1,998 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (C) 2010-2012 Ken Tossell
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the author nor other contributors may be
+*     used to endorse or promote products derived from this software
+*     without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+/* Microbenchmarks for the stream engine and the frame conversions. The
+ * stream cases drive the payload path directly, so no camera is needed.
+ * Inputs are generated from a fixed seed, so runs are comparable.
+ *
+ * Throughput cases report MB/s of input bytes and ns per pixel. The simd
+ * case instead checks each vector kernel against the scalar one, and a
+ * mismatch makes the exit status non-zero.
+ *
+ * Usage: uvc_bench [name-filter]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+#ifdef LIBUVC_HAS_JPEG
+#include <jpeglib.h>
+#endif
+
+typedef std::chrono::steady_clock bench_clock;
+
+static const struct {
+  int width, height;
+} bench_sizes[] = {
+  {640, 480},
+  {1280, 720},
+  {1920, 1080},
+  {3840, 2160},
+};
+
+/* Call fn once to warm up, then repeatedly for at least a quarter second.
+ * Returns the mean time per call in seconds. */
+template <typename F>
+static double time_per_call(F fn) {
+  const double min_time = 0.25;
+  size_t iters = 1;
+
+  fn();
+  for (;;) {
+    auto t0 = bench_clock::now();
+    for (size_t i = 0; i < iters; ++i)
+      fn();
+    double s = std::chrono::duration<double>(bench_clock::now() - t0).count();
+
+    if (s >= min_time)
+      return s / iters;
+    iters = s > 0 ? std::max(iters * 2, (size_t) (iters * min_time * 1.2 / s)) : iters * 10;
+  }
+}
+
+static void report(const char *label, int width, int height, size_t bytes, double s) {
+  printf("  %-20s %4dx%-4d %10.1f MB/s %8.3f ns/px\n", label, width, height,
+         bytes / s / 1e6, s * 1e9 / ((double) width * height));
+}
+
+/* Deterministic pseudo-random bytes */
+static uint8_t bench_rand(uint32_t *state) {
+  *state = *state * 1664525u + 1013904223u;
+  return (uint8_t) (*state >> 24);
+}
+
+/* A stream handle wired to a fake device with a single frame descriptor,
+ * enough for the payload path and frame population to run. */
+struct fake_stream {
+  uvc_device_handle_t devh;
+  uvc_streaming_interface_t stream_if;
+  uvc_format_desc_t format_desc;
+  uvc_frame_desc_t frame_desc;
+  uvc_stream_handle_t strmh;
+
+  fake_stream(enum uvc_frame_format frame_format, int width, int height, size_t frame_size) {
+    /* Tail shared by the GUIDs of uncompressed formats; MJPEG is a bare fourcc */
+    static const uint8_t guid_tail[12] = {
+      0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71
+    };
+    const char *fourcc = frame_format == UVC_FRAME_FORMAT_MJPEG ? "MJPG" :
+                         frame_format == UVC_FRAME_FORMAT_UYVY ? "UYVY" :
+                         frame_format == UVC_FRAME_FORMAT_NV12 ? "NV12" : "YUY2";
+
+    devh.info = new uvc_device_info_t();
+    memset(devh.info, 0, sizeof(*devh.info));
+    memset(&stream_if, 0, sizeof(stream_if));
+
+    format_desc.bFormatIndex = 1;
+    format_desc.parent = &stream_if;
+    memcpy(format_desc.guidFormat, fourcc, 4);
+    if (frame_format != UVC_FRAME_FORMAT_MJPEG)
+      memcpy(format_desc.guidFormat + 4, guid_tail, sizeof(guid_tail));
+    frame_desc.bFrameIndex = 1;
+    frame_desc.wWidth = width;
+    frame_desc.wHeight = height;
+    frame_desc.parent = &format_desc;
+    DL_APPEND(format_desc.frame_descs, &frame_desc);
+    DL_APPEND(stream_if.format_descs, &format_desc);
+    DL_APPEND(devh.info->stream_ifs, &stream_if);
+
+    strmh.devh = &devh;
+    strmh.stream_if = &stream_if;
+    strmh.frame_format = frame_format;
+    strmh.frame.library_owns_data = 1;
+    strmh.cur_ctrl.bFormatIndex = 1;
+    strmh.cur_ctrl.bFrameIndex = 1;
+    strmh.cur_ctrl.dwMaxVideoFrameSize = frame_size;
+  }
+
+  ~fake_stream() {
+    _uvc_frame_data_free(strmh.frame.data);
+    free(strmh.frame.nal_units);
+  }
+
+  /* Start the consumer side the way uvc_stream_start() does */
+  void start(uvc_frame_callback_t *cb, void *user_ptr, uint8_t flags) {
+    strmh.running = 1;
+    strmh.seq = 1;
+    strmh.fid = 0;
+    _uvc_stream_alloc_frame_buffers(&strmh);
+    strmh.user_cb = cb;
+    strmh.user_ptr = user_ptr;
+    strmh.flags = flags;
+    if (cb && !(flags & UVC_STREAM_FLAG_INLINE_CALLBACK))
+      strmh.callback_thread = std::thread(_uvc_user_caller, (void *) &strmh);
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(strmh.callback_mutex);
+      strmh.running = 0;
+    }
+    strmh.callback_cond.notify_all();
+    if (strmh.callback_thread.joinable())
+      strmh.callback_thread.join();
+  }
+};
+
+/* Split a frame into UVC payloads of at most packet_bytes, each with a
+ * 12-byte header (PTS + SCR), toggling FID per frame and setting EOF on
+ * the last payload. The frame is data, or a counting pattern if NULL. */
+static void make_payloads(size_t frame_bytes, size_t packet_bytes, uint8_t fid,
+    std::vector<std::vector<uint8_t> > *payloads, const uint8_t *data = NULL) {
+  const size_t header_len = 12;
+  size_t data_per_packet = packet_bytes - header_len;
+  size_t offset = 0;
+
+  payloads->clear();
+  while (offset < frame_bytes) {
+    size_t n = std::min(data_per_packet, frame_bytes - offset);
+    std::vector<uint8_t> p(header_len + n);
+
+    p[0] = header_len;
+    p[1] = UVC_STREAM_EOH | UVC_STREAM_PTS | UVC_STREAM_SCR | fid;
+    offset += n;
+    if (offset == frame_bytes)
+      p[1] |= UVC_STREAM_EOF;
+    if (data)
+      memcpy(&p[header_len], data + offset - n, n);
+    else
+      for (size_t i = 0; i < n; ++i)
+        p[header_len + i] = (uint8_t) (offset + i);
+
+    payloads->push_back(p);
+  }
+}
+
+static void print_percentiles(const char *label, std::vector<double> *samples) {
+  if (samples->empty()) {
+    printf("  %-14s no samples\n", label);
+    return;
+  }
+
+  std::sort(samples->begin(), samples->end());
+  auto pct = [&](double p) {
+    return (*samples)[std::min(samples->size() - 1, (size_t) (p * samples->size()))];
+  };
+  printf("  %-14s n=%-8zu p50=%8.2fus p99=%8.2fus p99.9=%8.2fus max=%8.2fus\n",
+         label, samples->size(), pct(0.5), pct(0.99), pct(0.999), samples->back());
+}
+
+struct handoff_consumer {
+  uvc_stream_handle_t *strmh;
+  std::vector<uint8_t> sink;
+};
+
+static void handoff_cb(uvc_frame_t *frame, void *ptr) {
+  handoff_consumer *c = (handoff_consumer *) ptr;
+
+  /* Simulate a consumer that touches the whole frame */
+  if (c->sink.size() < frame->data_bytes)
+    c->sink.resize(frame->data_bytes);
+  memcpy(c->sink.data(), frame->data, frame->data_bytes);
+
+  if (c->strmh->flags & UVC_STREAM_FLAG_ZERO_COPY)
+    uvc_stream_release_frame(c->strmh, frame);
+}
+
+/* Event-thread stall distribution: time every _uvc_process_payload call
+ * while a callback thread consumes frames concurrently. EOF payloads include
+ * the producer/consumer handoff. */
+static void bench_handoff() {
+  const int width = 1920, height = 1080;
+  const size_t frame_bytes = width * height * 2;
+  const size_t packet_bytes = 3 * 1024;
+  const int num_frames = 300;
+
+  for (int pass = 0; pass < 2; ++pass) {
+    uint8_t flags = pass ? UVC_STREAM_FLAG_ZERO_COPY : 0;
+    fake_stream fs(UVC_FRAME_FORMAT_YUYV, width, height, frame_bytes);
+    handoff_consumer consumer;
+    std::vector<std::vector<uint8_t> > payloads[2];
+    std::vector<double> all_us, eof_us;
+
+    consumer.strmh = &fs.strmh;
+    make_payloads(frame_bytes, packet_bytes, 0, &payloads[0]);
+    make_payloads(frame_bytes, packet_bytes, 1, &payloads[1]);
+    all_us.reserve(num_frames * payloads[0].size());
+
+    fs.start(handoff_cb, &consumer, flags);
+
+    auto t_start = bench_clock::now();
+    for (int f = 0; f < num_frames; ++f) {
+      for (auto &p : payloads[f & 1]) {
+        auto t0 = bench_clock::now();
+        _uvc_process_payload(&fs.strmh, p.data(), p.size());
+        double us = std::chrono::duration<double, std::micro>(bench_clock::now() - t0).count();
+
+        all_us.push_back(us);
+        if (p[1] & UVC_STREAM_EOF)
+          eof_us.push_back(us);
+      }
+    }
+    double total_s = std::chrono::duration<double>(bench_clock::now() - t_start).count();
+
+    /* let the consumer drain what is queued */
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    fs.stop();
+
+    uvc_stream_stats_t stats;
+    uvc_stream_get_stats(&fs.strmh, &stats);
+    printf(" %s: %d frames produced, %llu delivered, %llu dropped, %.1f frames/s\n",
+           pass ? "zero-copy" : "copy", num_frames,
+           (unsigned long long) stats.frames_delivered,
+           (unsigned long long) stats.frames_dropped, num_frames / total_s);
+    print_percentiles("all payloads", &all_us);
+    print_percentiles("EOF payloads", &eof_us);
+  }
+}
+
+struct trigger_consumer {
+  /* When the producer started on the frame's EOF payload */
+  bench_clock::time_point eof;
+  std::atomic<int> frames;
+  std::vector<double> us;
+};
+
+static void trigger_cb(uvc_frame_t *, void *ptr) {
+  trigger_consumer *c = (trigger_consumer *) ptr;
+
+  c->us.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - c->eof).count());
+  c->frames.fetch_add(1, std::memory_order_release);
+}
+
+/* Trigger latency: time from the arrival of a frame's EOF payload to the
+ * callback's first instruction, with the callback thread asleep between
+ * frames as it is at camera frame rates, against an inline callback. */
+static void bench_trigger() {
+  const int width = 640, height = 480;
+  const size_t frame_bytes = width * height * 2;
+  const size_t packet_bytes = 3 * 1024;
+  const int num_frames = 500;
+
+  for (int pass = 0; pass < 2; ++pass) {
+    uint8_t flags = pass ? UVC_STREAM_FLAG_INLINE_CALLBACK : 0;
+    fake_stream fs(UVC_FRAME_FORMAT_YUYV, width, height, frame_bytes);
+    trigger_consumer consumer;
+    std::vector<std::vector<uint8_t> > payloads[2];
+
+    consumer.frames = 0;
+    consumer.us.reserve(num_frames);
+    make_payloads(frame_bytes, packet_bytes, 0, &payloads[0]);
+    make_payloads(frame_bytes, packet_bytes, 1, &payloads[1]);
+
+    fs.start(trigger_cb, &consumer, flags);
+
+    for (int f = 0; f < num_frames; ++f) {
+      const auto &frame = payloads[f & 1];
+
+      for (size_t i = 0; i + 1 < frame.size(); ++i)
+        _uvc_process_payload(&fs.strmh, (uint8_t *) frame[i].data(), frame[i].size());
+
+      consumer.eof = bench_clock::now();
+      _uvc_process_payload(&fs.strmh, (uint8_t *) frame.back().data(), frame.back().size());
+
+      auto deadline = bench_clock::now() + std::chrono::seconds(1);
+      while (consumer.frames.load(std::memory_order_acquire) <= f &&
+             bench_clock::now() < deadline)
+        std::this_thread::yield();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    fs.stop();
+    print_percentiles(pass ? "inline" : "threaded", &consumer.us);
+  }
+}
+
+struct slice_consumer {
+  int sliced;
+  uvc_frame_t rgb;
+  bench_clock::time_point eof;
+  std::vector<double> us;
+};
+
+/* Convert rows [first, first + rows) of a YUYV frame into the consumer's
+ * RGB buffer */
+static void slice_convert(slice_consumer *c, uvc_frame_t *frame, size_t first, size_t rows) {
+  uvc_frame_t in = *frame, out = c->rgb;
+
+  in.data = (uint8_t *) frame->data + first * frame->step;
+  in.data_bytes = rows * frame->step;
+  in.height = rows;
+  in.source = NULL;
+  out.data = (uint8_t *) c->rgb.data + first * c->rgb.step;
+  out.data_bytes = rows * c->rgb.step;
+  uvc_yuyv2rgb(&in, &out);
+}
+
+static void slice_cb(uvc_frame_t *frame, size_t offset, void *ptr) {
+  slice_consumer *c = (slice_consumer *) ptr;
+
+  slice_convert(c, frame, offset / frame->step,
+                (frame->data_bytes - offset) / frame->step);
+}
+
+static void slice_frame_cb(uvc_frame_t *frame, void *ptr) {
+  slice_consumer *c = (slice_consumer *) ptr;
+
+  /* Unsliced, the whole frame is converted now; sliced, it already is */
+  if (!c->sliced)
+    slice_convert(c, frame, 0, frame->height);
+  c->us.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - c->eof).count());
+}
+
+/* End-to-end latency of converting 4K YUYV frames to RGB, from the arrival
+ * of each frame's EOF payload to the last row converted: the whole frame
+ * after EOF, against 64-row slices converted as the frame arrives. Both
+ * run inline on the producer thread. */
+static void bench_slice() {
+  const int width = 3840, height = 2160;
+  const size_t frame_bytes = width * height * 2;
+  const size_t packet_bytes = 3 * 1024;
+  const int num_frames = 30;
+
+  for (int sliced = 0; sliced < 2; ++sliced) {
+    fake_stream fs(UVC_FRAME_FORMAT_YUYV, width, height, frame_bytes);
+    std::vector<uint8_t> rgb((size_t) width * height * 3);
+    std::vector<std::vector<uint8_t> > payloads[2];
+    slice_consumer consumer;
+
+    consumer.rgb = uvc_frame_t();
+    consumer.rgb.data = rgb.data();
+    consumer.rgb.data_bytes = rgb.size();
+    consumer.rgb.step = width * 3;
+    make_payloads(frame_bytes, packet_bytes, 0, &payloads[0]);
+    make_payloads(frame_bytes, packet_bytes, 1, &payloads[1]);
+
+    consumer.sliced = sliced;
+    if (sliced)
+      uvc_stream_set_slice_callback(&fs.strmh, slice_cb, &consumer, 64 * width * 2);
+    fs.start(slice_frame_cb, &consumer, UVC_STREAM_FLAG_INLINE_CALLBACK);
+
+    for (int f = 0; f < num_frames; ++f) {
+      const auto &frame = payloads[f & 1];
+
+      for (size_t i = 0; i + 1 < frame.size(); ++i)
+        _uvc_process_payload(&fs.strmh, (uint8_t *) frame[i].data(), frame[i].size());
+      consumer.eof = bench_clock::now();
+      _uvc_process_payload(&fs.strmh, (uint8_t *) frame.back().data(), frame.back().size());
+    }
+
+    fs.stop();
+    print_percentiles(sliced ? "64-row slices" : "whole frame", &consumer.us);
+  }
+}
+
+/* Payload assembly throughput: replay a payload stream through
+ * _uvc_process_payload with nobody consuming frames, for packet sizes typical
+ * of isochronous (1 KB, 3 KB high-bandwidth) and bulk (16 KB, whole frame)
+ * endpoints. */
+static void bench_payload() {
+  for (const auto &size : bench_sizes) {
+    const size_t frame_bytes = size.width * size.height * 2;
+    const size_t packet_sizes[] = {1024, 3 * 1024, 16 * 1024, frame_bytes + 12};
+
+    for (size_t packet_bytes : packet_sizes) {
+      fake_stream fs(UVC_FRAME_FORMAT_YUYV, size.width, size.height, frame_bytes);
+      std::vector<std::vector<uint8_t> > payloads[2];
+      int f = 0;
+      char label[32];
+
+      make_payloads(frame_bytes, packet_bytes, 0, &payloads[0]);
+      make_payloads(frame_bytes, packet_bytes, 1, &payloads[1]);
+      fs.start(NULL, NULL, 0);
+
+      double s = time_per_call([&]() {
+        for (auto &p : payloads[f++ & 1])
+          _uvc_process_payload(&fs.strmh, p.data(), p.size());
+      });
+
+      fs.stop();
+
+      if (packet_bytes > frame_bytes)
+        snprintf(label, sizeof(label), "packet frame");
+      else
+        snprintf(label, sizeof(label), "packet %zu", packet_bytes);
+      report(label, size.width, size.height, frame_bytes, s);
+    }
+  }
+}
+
+/* Bulk endpoints that send a whole frame per transfer: compare assembling
+ * the payload (copy) against swapping the transfer buffer into the pool. */
+static void bench_bulk() {
+  const int width = 1920, height = 1080;
+  const size_t frame_bytes = width * height * 2;
+  const size_t header_len = 12;
+  const int num_frames = 500;
+
+  for (int direct = 0; direct < 2; ++direct) {
+    fake_stream fs(UVC_FRAME_FORMAT_YUYV, width, height, frame_bytes);
+    struct libusb_transfer transfer;
+
+    fs.strmh.cur_ctrl.dwMaxPayloadTransferSize = header_len + frame_bytes;
+    memset(&transfer, 0, sizeof(transfer));
+    transfer.length = header_len + frame_bytes;
+    transfer.buffer = (uint8_t *) malloc(transfer.length);
+    memset(transfer.buffer, 0x80, transfer.length);
+    fs.start(NULL, NULL, 0);
+
+    auto t_start = bench_clock::now();
+    for (int f = 0; f < num_frames; ++f) {
+      /* the device (DMA) fills in the image; we only write the header */
+      transfer.buffer[0] = header_len;
+      transfer.buffer[1] = UVC_STREAM_EOH | UVC_STREAM_PTS | UVC_STREAM_SCR |
+                           UVC_STREAM_EOF | (f & 1);
+      transfer.actual_length = transfer.length;
+
+      if (direct)
+        _uvc_process_bulk_transfer(&fs.strmh, &transfer);
+      else
+        _uvc_process_payload(&fs.strmh, transfer.buffer, transfer.actual_length);
+    }
+    double total_s = std::chrono::duration<double>(bench_clock::now() - t_start).count();
+
+    fs.stop();
+    free(transfer.buffer);
+
+    printf("  %-6s %8.2f us/frame %10.0f frames/s\n", direct ? "direct" : "copy",
+           total_s * 1e6 / num_frames, num_frames / total_s);
+  }
+}
+
+static void replay_cb(uvc_frame_t *frame, void *ptr) {
+  uvc_stream_release_frame((uvc_stream_handle_t *) ptr, frame);
+}
+
+/* Write a capture of num_frames frames sent as isochronous transfers of
+ * 32 x 3 KB packets: copies of image if given, else 1080p YUYV */
+static bool write_synthetic_capture(const char *path, int num_frames, const uvc_frame_t *image = NULL) {
+  const int width = image ? image->width : 1920, height = image ? image->height : 1080;
+  const size_t frame_bytes = image ? image->data_bytes : width * height * 2;
+  const int packets_per_transfer = 32, packet_bytes = 3 * 1024;
+  fake_stream fs(image ? image->frame_format : UVC_FRAME_FORMAT_YUYV, width, height,
+                 std::max(frame_bytes, (size_t) width * height * 2));
+  const uint8_t *data = image ? (const uint8_t *) image->data : NULL;
+  std::vector<std::vector<uint8_t> > payloads[2];
+  struct libusb_transfer *transfer = libusb_alloc_transfer(packets_per_transfer);
+  std::vector<uint8_t> buf(packets_per_transfer * packet_bytes);
+
+  fs.strmh.cur_ctrl.dwMaxPayloadTransferSize = packet_bytes;
+  make_payloads(frame_bytes, packet_bytes, 0, &payloads[0], data);
+  make_payloads(frame_bytes, packet_bytes, 1, &payloads[1], data);
+  if (uvc_stream_start_capture(&fs.strmh, path) != UVC_SUCCESS) {
+    libusb_free_transfer(transfer);
+    return false;
+  }
+
+  transfer->buffer = buf.data();
+  transfer->status = LIBUSB_TRANSFER_COMPLETED;
+  for (int f = 0; f < num_frames; ++f) {
+    const auto &frame = payloads[f & 1];
+
+    for (size_t p = 0; p < frame.size(); p += packets_per_transfer) {
+      transfer->num_iso_packets = std::min(frame.size() - p, (size_t) packets_per_transfer);
+      for (int i = 0; i < transfer->num_iso_packets; ++i) {
+        memcpy(buf.data() + i * packet_bytes, frame[p + i].data(), frame[p + i].size());
+        transfer->iso_packet_desc[i].length = packet_bytes;
+        transfer->iso_packet_desc[i].actual_length = frame[p + i].size();
+        transfer->iso_packet_desc[i].status = LIBUSB_TRANSFER_COMPLETED;
+      }
+      _uvc_capture_transfer(fs.strmh.capture, transfer);
+    }
+  }
+
+  libusb_free_transfer(transfer);
+  return uvc_stream_stop_capture(&fs.strmh) == UVC_SUCCESS;
+}
+
+/* End-to-end replay, looping a capture at maximum speed for a second: the
+ * file named by UVC_BENCH_CAPTURE, or a synthetic one */
+static void bench_replay() {
+  const char *path = getenv("UVC_BENCH_CAPTURE");
+  const char *tmp_path = "uvc_bench_capture.bin";
+  uvc_stream_handle_t *strmh;
+  uvc_stream_stats_t stats;
+
+  if (!path) {
+    if (!write_synthetic_capture(tmp_path, 30)) {
+      printf("  failed to write %s\n", tmp_path);
+      return;
+    }
+    path = tmp_path;
+  }
+
+  if (uvc_stream_open_replay(path, UVC_REPLAY_FLAG_LOOP, &strmh) != UVC_SUCCESS) {
+    printf("  failed to open %s\n", path);
+    return;
+  }
+
+  auto t_start = bench_clock::now();
+  uvc_stream_start(strmh, replay_cb, strmh, UVC_STREAM_FLAG_ZERO_COPY);
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  uvc_stream_stop(strmh);
+  double total_s = std::chrono::duration<double>(bench_clock::now() - t_start).count();
+
+  uvc_stream_get_stats(strmh, &stats);
+  uvc_stream_close(strmh);
+  if (path == tmp_path)
+    remove(tmp_path);
+
+  printf("  %llu frames (%llu dropped), %.2f GB/s, %.0f frames/s\n",
+         (unsigned long long) stats.frames_completed,
+         (unsigned long long) stats.frames_dropped,
+         stats.payload_bytes / total_s / 1e9, stats.frames_completed / total_s);
+}
+
+/* A test frame of the given format with plausible content: smooth
+ * gradients plus noise, so compressed formats compress like camera images */
+static uvc_frame_t *make_test_frame(enum uvc_frame_format format, int width, int height) {
+  uint32_t seed = 12345;
+  uvc_frame_t *frame;
+
+  if (format == UVC_FRAME_FORMAT_MJPEG) {
+#ifdef LIBUVC_HAS_JPEG
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    std::vector<uint8_t> row(width * 3);
+    unsigned char *jpeg = NULL;
+    unsigned long jpeg_bytes = 0;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &jpeg, &jpeg_bytes);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 85, TRUE);
+    /* 4:2:2 with a restart marker per MCU row, as many cameras send */
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 1;
+    cinfo.restart_in_rows = 1;
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+      int y = cinfo.next_scanline;
+      unsigned char *rows[1] = {row.data()};
+
+      for (int x = 0; x < width; ++x) {
+        row[x * 3 + 0] = (uint8_t) (x * 255 / width + (bench_rand(&seed) & 15));
+        row[x * 3 + 1] = (uint8_t) (y * 255 / height + (bench_rand(&seed) & 15));
+        row[x * 3 + 2] = (uint8_t) ((x + y) / 4 + (bench_rand(&seed) & 15));
+      }
+      jpeg_write_scanlines(&cinfo, rows, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    frame = uvc_allocate_frame(jpeg_bytes);
+    memcpy(frame->data, jpeg, jpeg_bytes);
+    free(jpeg);
+    frame->step = 0;
+#else
+    return NULL;
+#endif
+  } else if (format == UVC_FRAME_FORMAT_NV12 || format == UVC_FRAME_FORMAT_GRAY16 ||
+             format == UVC_FRAME_FORMAT_SRGGB8) {
+    /* Sample planes of a gradient; the NV12 chroma plane follows the luma */
+    int bpp = format == UVC_FRAME_FORMAT_GRAY16 ? 2 : 1;
+    size_t bytes = (size_t) width * height * bpp;
+    uint8_t *p;
+
+    if (format == UVC_FRAME_FORMAT_NV12)
+      bytes += (size_t) width * (height / 2);
+    frame = uvc_allocate_frame(bytes);
+    p = (uint8_t *) frame->data;
+    for (size_t i = 0; i < bytes; ++i)
+      p[i] = (uint8_t) ((i % width) * 255 / width + (bench_rand(&seed) & 15));
+    frame->step = width * bpp;
+  } else {
+    uint8_t *p;
+
+    frame = uvc_allocate_frame(width * height * 2);
+    p = (uint8_t *) frame->data;
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; x += 2, p += 4) {
+        uint8_t y0 = (uint8_t) (x * 255 / width + (bench_rand(&seed) & 15));
+        uint8_t y1 = (uint8_t) (y0 + (bench_rand(&seed) & 3));
+        uint8_t u = (uint8_t) (y * 255 / height);
+        uint8_t v = (uint8_t) (255 - u + (bench_rand(&seed) & 7));
+
+        if (format == UVC_FRAME_FORMAT_UYVY) {
+          p[0] = u; p[1] = y0; p[2] = v; p[3] = y1;
+        } else {
+          p[0] = y0; p[1] = u; p[2] = y1; p[3] = v;
+        }
+      }
+    }
+    frame->step = width * 2;
+  }
+
+  frame->width = width;
+  frame->height = height;
+  frame->frame_format = format;
+  return frame;
+}
+
+struct conversion_case {
+  const char *name;
+  enum uvc_frame_format in_format;
+  uvc_error_t (*fn)(uvc_frame_t *in, uvc_frame_t *out);
+};
+
+#ifdef LIBUVC_HAS_JPEG
+/* Reduced-resolution decodes, as a preview or analytics path would run */
+template <int denom>
+static uvc_error_t mjpeg2rgb_scaled(uvc_frame_t *in, uvc_frame_t *out) {
+  static thread_local uvc_mjpeg_decoder_t *decoder;
+
+  if (!decoder && uvc_mjpeg_decoder_create(&decoder) != UVC_SUCCESS)
+    return UVC_ERROR_NO_MEM;
+  return uvc_mjpeg_decode_scaled(decoder, in, out, UVC_FRAME_FORMAT_RGB, denom);
+}
+
+/* The centre quarter of the frame, as an inspection region would be */
+static uvc_error_t mjpeg2rgb_roi(uvc_frame_t *in, uvc_frame_t *out) {
+  static thread_local uvc_mjpeg_decoder_t *decoder;
+  int width = in->width / 2, height = in->height / 2;
+
+  if (!decoder && uvc_mjpeg_decoder_create(&decoder) != UVC_SUCCESS)
+    return UVC_ERROR_NO_MEM;
+  return uvc_mjpeg_decode_roi(decoder, in, out, UVC_FRAME_FORMAT_RGB,
+      width / 2, height / 2, width, height);
+}
+#endif
+
+/* Whatever chain uvc_convert() picks, intermediates included */
+template <enum uvc_frame_format format>
+static uvc_error_t convert_to(uvc_frame_t *in, uvc_frame_t *out) {
+  return uvc_convert(in, out, format);
+}
+
+/* Conversion straight to an inference-sized frame, as a detector feed would */
+template <enum uvc_resize_filter filter>
+static uvc_error_t yuyv2rgb_360p(uvc_frame_t *in, uvc_frame_t *out) {
+  return uvc_yuv422_convert_resized(in, out, UVC_FRAME_FORMAT_RGB, 640, 360, filter);
+}
+
+static const conversion_case conversions[] = {
+  {"yuyv2rgb", UVC_FRAME_FORMAT_YUYV, uvc_yuyv2rgb},
+  {"yuyv2bgr", UVC_FRAME_FORMAT_YUYV, uvc_yuyv2bgr},
+  {"uyvy2rgb", UVC_FRAME_FORMAT_UYVY, uvc_uyvy2rgb},
+  {"uyvy2bgr", UVC_FRAME_FORMAT_UYVY, uvc_uyvy2bgr},
+  {"yuyv2y", UVC_FRAME_FORMAT_YUYV, uvc_yuyv2y},
+  {"yuyv2i420", UVC_FRAME_FORMAT_YUYV, uvc_yuyv2i420},
+  {"yuyv2nv12", UVC_FRAME_FORMAT_YUYV, uvc_yuyv2nv12},
+  {"yuyv2rgb_360p_nearest", UVC_FRAME_FORMAT_YUYV, yuyv2rgb_360p<UVC_RESIZE_NEAREST>},
+  {"yuyv2rgb_360p_bilinear", UVC_FRAME_FORMAT_YUYV, yuyv2rgb_360p<UVC_RESIZE_BILINEAR>},
+  {"nv122rgb", UVC_FRAME_FORMAT_NV12, uvc_nv122rgb},
+  {"gray162rgb", UVC_FRAME_FORMAT_GRAY16, uvc_any2rgb},
+  {"bayer2rgb", UVC_FRAME_FORMAT_SRGGB8, uvc_bayer2rgb},
+  {"convert_uyvy2gray", UVC_FRAME_FORMAT_UYVY, convert_to<UVC_FRAME_FORMAT_GRAY8>},
+  {"duplicate_frame", UVC_FRAME_FORMAT_YUYV, uvc_duplicate_frame},
+#ifdef LIBUVC_HAS_JPEG
+  {"mjpeg2rgb", UVC_FRAME_FORMAT_MJPEG, uvc_mjpeg2rgb},
+  {"mjpeg2i420", UVC_FRAME_FORMAT_MJPEG, uvc_mjpeg2i420},
+  {"mjpeg2nv12", UVC_FRAME_FORMAT_MJPEG, uvc_mjpeg2nv12},
+  {"convert_mjpeg2bgr", UVC_FRAME_FORMAT_MJPEG, convert_to<UVC_FRAME_FORMAT_BGR>},
+  {"mjpeg2rgb_1/2", UVC_FRAME_FORMAT_MJPEG, mjpeg2rgb_scaled<2>},
+  {"mjpeg2rgb_1/4", UVC_FRAME_FORMAT_MJPEG, mjpeg2rgb_scaled<4>},
+  {"mjpeg2rgb_1/8", UVC_FRAME_FORMAT_MJPEG, mjpeg2rgb_scaled<8>},
+  {"mjpeg2rgb_roi", UVC_FRAME_FORMAT_MJPEG, mjpeg2rgb_roi},
+#endif
+};
+
+/* Each size runs single-threaded, then striped over every hardware thread */
+static void bench_conversion(const conversion_case &c) {
+  /* The input claims a device in a context so the conversion pool applies */
+  uvc_context_t ctx;
+  uvc_device_t dev;
+  uvc_device_handle_t devh;
+  int max_threads = (int) std::thread::hardware_concurrency();
+
+  dev.ctx = &ctx;
+  devh.dev = &dev;
+
+  for (const auto &size : bench_sizes) {
+    uvc_frame_t *in = make_test_frame(c.in_format, size.width, size.height);
+
+    in->source = &devh;
+    for (int threads = 1; ; threads = max_threads) {
+      uvc_frame_t *out = uvc_allocate_frame(0);
+      uvc_error_t ret = UVC_SUCCESS;
+      char label[64];
+
+      uvc_set_conversion_threads(&ctx, threads);
+      double s = time_per_call([&]() {
+        ret = c.fn(in, out);
+      });
+
+      snprintf(label, sizeof(label), "%s/%dt", c.name, threads);
+      if (ret != UVC_SUCCESS)
+        printf("  %dx%d failed: %s\n", size.width, size.height, uvc_strerror(ret));
+      else
+        report(label, size.width, size.height, in->data_bytes, s);
+
+      uvc_free_frame(out);
+      if (threads >= max_threads)
+        break;
+    }
+
+    uvc_free_frame(in);
+  }
+
+  uvc_set_conversion_threads(&ctx, 0);
+}
+
+#ifdef LIBUVC_HAS_JPEG
+struct decode_state {
+  uint32_t last_sequence;
+  uint64_t out_of_order;
+};
+
+static void decode_cb(uvc_frame_t *frame, void *ptr) {
+  struct decode_state *state = (struct decode_state *) ptr;
+
+  if (frame->sequence <= state->last_sequence)
+    state->out_of_order++;
+  state->last_sequence = frame->sequence;
+}
+
+/* Pipelined MJPEG decode: a looping 1080p MJPEG capture decoded to RGB for
+ * a second by one worker, then by one per hardware thread */
+static void bench_decode() {
+  const char *tmp_path = "uvc_bench_decode.bin";
+  int max_threads = (int) std::thread::hardware_concurrency();
+  uvc_frame_t *image = make_test_frame(UVC_FRAME_FORMAT_MJPEG, 1920, 1080);
+  bool written = write_synthetic_capture(tmp_path, 30, image);
+
+  uvc_free_frame(image);
+  if (!written) {
+    printf("  failed to write %s\n", tmp_path);
+    return;
+  }
+
+  for (int threads = 1; ; threads = max_threads) {
+    uvc_stream_handle_t *strmh;
+    uvc_stream_stats_t stats;
+    struct decode_state state = {0, 0};
+
+    if (uvc_stream_open_replay(tmp_path, UVC_REPLAY_FLAG_LOOP, &strmh) != UVC_SUCCESS) {
+      printf("  failed to open %s\n", tmp_path);
+      break;
+    }
+
+    uvc_stream_set_decode(strmh, UVC_FRAME_FORMAT_RGB, threads);
+    auto t_start = bench_clock::now();
+    uvc_stream_start(strmh, decode_cb, &state, 0);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    uvc_stream_stop(strmh);
+    double total_s = std::chrono::duration<double>(bench_clock::now() - t_start).count();
+
+    uvc_stream_get_stats(strmh, &stats);
+    uvc_stream_close(strmh);
+
+    printf("  %2d threads: %.0f frames/s decoded, %llu out of order, %llu errors\n",
+           threads, stats.frames_delivered / total_s,
+           (unsigned long long) state.out_of_order,
+           (unsigned long long) stats.decode_errors);
+    if (threads >= max_threads)
+      break;
+  }
+
+  remove(tmp_path);
+}
+#endif
+
+static const char *const simd_level_names[] = {"none", "ssse3", "avx2", "neon"};
+static int simd_failures;
+
+/* Check every vector kernel the getter returns against its scalar
+ * reference: each length up to 130 pixels in steps of step, several times
+ * over, on random input read from an unaligned address. The output is
+ * compared byte for byte, along with a guard tail that must stay
+ * untouched. call(fn, in, out, pixels, r) runs one kernel, with r a random
+ * value for its parameters. */
+template <typename Fn, typename Get, typename Call>
+static void check_kernel(const char *name, Get get, Call call, size_t step,
+    size_t in_bpp, size_t out_bpp) {
+  const size_t guard = 64;
+  Fn ref = get(UVC_SIMD_NONE), prev = ref;
+
+  for (int level = UVC_SIMD_SSSE3; level <= UVC_SIMD_NEON; ++level) {
+    Fn fn = get((enum uvc_simd_level) level);
+    uint32_t seed = 4321;
+    size_t bad_pixels = 0, bad_byte = 0;
+
+    /* Levels the CPU lacks, or that have no kernel of their own, fall back
+     * to one already checked */
+    if (level > _uvc_simd_level() || fn == prev)
+      continue;
+    prev = fn;
+
+    for (size_t n = step; n <= 130 && !bad_pixels; n += step) {
+      for (int round = 0; round < 16 && !bad_pixels; ++round) {
+        std::vector<uint8_t> in(n * in_bpp + 1);
+        std::vector<uint8_t> want(n * out_bpp + guard, 0xa5), got(want);
+        uint32_t r;
+
+        for (auto &b : in)
+          b = bench_rand(&seed);
+        r = seed;
+        call(ref, in.data() + 1, want.data(), n, r);
+        call(fn, in.data() + 1, got.data(), n, r);
+        if (want != got) {
+          bad_pixels = n;
+          bad_byte = std::mismatch(want.begin(), want.end(), got.begin()).first - want.begin();
+        }
+      }
+    }
+
+    if (bad_pixels) {
+      printf("  %-18s %-6s MISMATCH at %zu pixels, byte %zu\n", name,
+             simd_level_names[level], bad_pixels, bad_byte);
+      ++simd_failures;
+    } else {
+      printf("  %-18s %-6s ok\n", name, simd_level_names[level]);
+    }
+  }
+}
+
+/* Bit-exactness of every conversion kernel at every instruction set level
+ * this CPU has; a mismatch makes uvc_bench exit non-zero */
+static void bench_simd() {
+  static const char *const rgb_names[2] = {"rgb", "bgr"};
+  char name[32];
+
+  for (int uyvy = 0; uyvy < 2; ++uyvy) {
+    for (int bgr = 0; bgr < 2; ++bgr) {
+      snprintf(name, sizeof(name), "%s2%s", uyvy ? "uyvy" : "yuyv", rgb_names[bgr]);
+      check_kernel<uvc_yuv422_rgb_fn>(name,
+          [&](enum uvc_simd_level level) { return _uvc_get_yuv422_rgb(uyvy, bgr, level); },
+          [](uvc_yuv422_rgb_fn fn, const uint8_t *in, uint8_t *out, size_t n, uint32_t) {
+            fn(in, out, n);
+          }, 2, 2, 3);
+    }
+
+    for (int nv12 = 0; nv12 < 2; ++nv12) {
+      snprintf(name, sizeof(name), "%s2%s", uyvy ? "uyvy" : "yuyv", nv12 ? "nv12" : "i420");
+      /* Two input rows in; Y rows, then U and V (or the U,V pairs) out */
+      check_kernel<uvc_yuv422_420_fn>(name,
+          [&](enum uvc_simd_level level) { return _uvc_get_yuv422_420(uyvy, nv12, level); },
+          [&](uvc_yuv422_420_fn fn, const uint8_t *in, uint8_t *out, size_t n, uint32_t) {
+            fn(in, in + 2 * n, out, out + n, out + 2 * n, nv12 ? NULL : out + 2 * n + n / 2, n);
+          }, 2, 4, 3);
+    }
+  }
+
+  for (int uyvy = 0; uyvy < 2; ++uyvy) {
+    check_kernel<uvc_yuv422_y_fn>(uyvy ? "uyvy2y" : "yuyv2y",
+        [&](enum uvc_simd_level level) { return _uvc_get_yuv422_y(uyvy, level); },
+        [](uvc_yuv422_y_fn fn, const uint8_t *in, uint8_t *out, size_t n, uint32_t) {
+          fn(in, out, n);
+        }, 1, 2, 1);
+  }
+
+  for (int bgr = 0; bgr < 2; ++bgr) {
+    snprintf(name, sizeof(name), "nv122%s", rgb_names[bgr]);
+    check_kernel<uvc_nv12_rgb_fn>(name,
+        [&](enum uvc_simd_level level) { return _uvc_get_nv12_rgb(bgr, level); },
+        [](uvc_nv12_rgb_fn fn, const uint8_t *in, uint8_t *out, size_t n, uint32_t) {
+          fn(in, in + n, out, n);
+        }, 2, 2, 3);
+
+    snprintf(name, sizeof(name), "bayer2%s", rgb_names[bgr]);
+    /* Three input rows; r picks the Bayer pattern */
+    check_kernel<uvc_bayer_rgb_fn>(name,
+        [&](enum uvc_simd_level level) { return _uvc_get_bayer_rgb(bgr, level); },
+        [](uvc_bayer_rgb_fn fn, const uint8_t *in, uint8_t *out, size_t n, uint32_t r) {
+          fn(in, in + n, in + 2 * n, out, n, (int) (r >> 30));
+        }, 2, 3, 3);
+  }
+
+  check_kernel<uvc_gray_rgb_fn>("gray2rgb", _uvc_get_gray_rgb,
+      [](uvc_gray_rgb_fn fn, const uint8_t *in, uint8_t *out, size_t n, uint32_t) {
+        fn(in, out, n);
+      }, 1, 1, 3);
+
+  /* r picks a shift of 0-8 and any offset */
+  check_kernel<uvc_gray16_fn>("gray162gray", _uvc_get_gray16,
+      [](uvc_gray16_fn fn, const uint8_t *in, uint8_t *out, size_t n, uint32_t r) {
+        fn(in, out, n, (int) ((r >> 28) % 9), (uint16_t) r);
+      }, 1, 2, 1);
+}
+
+struct bench_case {
+  const char *name;
+  void (*fn)();
+};
+
+static const bench_case benches[] = {
+  {"simd", bench_simd},
+  {"handoff", bench_handoff},
+  {"trigger", bench_trigger},
+  {"slice", bench_slice},
+  {"payload", bench_payload},
+  {"bulk", bench_bulk},
+  {"replay", bench_replay},
+#ifdef LIBUVC_HAS_JPEG
+  {"decode", bench_decode},
+#endif
+};
+
+int main(int argc, char **argv) {
+  const char *filter = argc > 1 ? argv[1] : "";
+
+  for (const auto &b : benches) {
+    if (!strstr(b.name, filter))
+      continue;
+    printf("%s\n", b.name);
+    b.fn();
+  }
+
+  for (const auto &c : conversions) {
+    if (!strstr(c.name, filter))
+      continue;
+    printf("%s\n", c.name);
+    bench_conversion(c);
+  }
+
+  return simd_failures ? 1 : 0;
+}
@@ -53,6 +53,19 @@ static void _error_exit(j_common_ptr dinfo) {
   longjmp(myerr->jmp, 1);
 }
 
+/* Corrupt frames are routine on a lossy link, and libjpeg would print a
+ * warning or error for each one; keep them to debug builds */
+static void _output_message(j_common_ptr dinfo) {
+#ifdef UVC_DEBUGGING
+  char buffer[JMSG_LENGTH_MAX];
+
+  (*dinfo->err->format_message)(dinfo, buffer);
+  UVC_DEBUG("libjpeg: %s", buffer);
+#else
+  (void) dinfo;
+#endif
+}
+
 /* ISO/IEC 10918-1:1993(E) K.3.3. Default Huffman tables used by MJPEG UVC devices
    which don't specify a Huffman table in the JPEG stream. */
 static const unsigned char dc_lumi_len[] = 
@@ -122,101 +135,1014 @@ static void insert_huff_tables(j_decompress_ptr dinfo) {
   COPY_HUFF_TABLE(dinfo, ac_huff_tbl_ptrs[1], ac_chromi);
 }
 
-static uvc_error_t uvc_mjpeg_convert(uvc_frame_t *in, uvc_frame_t *out) {
+static int huff_table_empty(const JHUFF_TBL *table) {
+  for (int i = 1; i <= 16; ++i) {
+    if (table->bits[i])
+      return 0;
+  }
+  return 1;
+}
+
+/** A libjpeg decompressor kept across frames */
+struct uvc_mjpeg_decoder {
   struct jpeg_decompress_struct dinfo;
   struct error_mgr jerr;
-  size_t lines_read;
-  dinfo.err = jpeg_std_error(&jerr.super);
-  jerr.super.error_exit = _error_exit;
+};
 
-  if (setjmp(jerr.jmp)) {
-    goto fail;
+/** @brief Create a reusable MJPEG decoder
+ * @ingroup frame
+ *
+ * A decoder keeps its libjpeg decompressor, with the permanent memory
+ * pool, source manager and table storage, from one frame to the next.
+ * uvc_mjpeg2rgb() and uvc_mjpeg2gray() use a decoder per calling thread;
+ * create one explicitly to tie it to a stream instead. A decoder must
+ * not be used by two threads at once.
+ *
+ * @param[out] decoder New decoder; free with uvc_mjpeg_decoder_destroy()
+ */
+uvc_error_t uvc_mjpeg_decoder_create(uvc_mjpeg_decoder_t **decoder) {
+  uvc_mjpeg_decoder_t *dec = new uvc_mjpeg_decoder_t();
+
+  dec->dinfo.err = jpeg_std_error(&dec->jerr.super);
+  dec->jerr.super.error_exit = _error_exit;
+  dec->jerr.super.output_message = _output_message;
+
+  if (setjmp(dec->jerr.jmp)) {
+    delete dec;
+    return UVC_ERROR_NO_MEM;
   }
 
-  jpeg_create_decompress(&dinfo);
-  jpeg_mem_src(&dinfo, (const unsigned char*)in->data, in->data_bytes);
-  jpeg_read_header(&dinfo, TRUE);
+  jpeg_create_decompress(&dec->dinfo);
+
+  *decoder = dec;
+  return UVC_SUCCESS;
+}
+
+/** @brief Free an MJPEG decoder
+ * @ingroup frame
+ *
+ * @param decoder Decoder from uvc_mjpeg_decoder_create(); NULL is ignored
+ */
+void uvc_mjpeg_decoder_destroy(uvc_mjpeg_decoder_t *decoder) {
+  if (!decoder)
+    return;
+
+  jpeg_destroy_decompress(&decoder->dinfo);
+  delete decoder;
+}
+
+/** @internal
+ * @brief The calling thread's decoder, created on first use
+ */
+static uvc_mjpeg_decoder_t *thread_decoder(void) {
+  struct holder {
+    uvc_mjpeg_decoder_t *decoder;
+    holder() : decoder(nullptr) {}
+    ~holder() { uvc_mjpeg_decoder_destroy(decoder); }
+  };
+  static thread_local holder local;
+
+  if (!local.decoder && uvc_mjpeg_decoder_create(&local.decoder) != UVC_SUCCESS)
+    local.decoder = NULL;
+
+  return local.decoder;
+}
+
+/** Where a decode writes its pixels */
+struct mjpeg_target {
+  uint8_t *data;
+  /** Bytes from one output row to the next */
+  size_t step;
+  /** Largest image that fits the buffer */
+  int width;
+  int height;
+  J_COLOR_SPACE color_space;
+  /** Decode at 1/scale_denom of the coded size: 1, 2, 4 or 8 */
+  int scale_denom;
+  /** If set, decode only the width x height region whose top-left
+   * corner is at (x, y) of the decoded image */
+  int crop;
+  int x;
+  int y;
+};
+
+/** Output size of a dimension decoded at 1/denom scale */
+#define MJPEG_SCALED(size, denom) (((size) + (denom) - 1) / (denom))
+
+/** Scanlines handed to libjpeg per call; covers an MCU row at 4x vertical sampling */
+#define MJPEG_ROWS_PER_READ 32
+
+/* libjpeg-turbo 1.5 added jpeg_crop_scanline() and jpeg_skip_scanlines();
+ * its numeric version macro only arrived with 2.0, so 1.5.x takes the
+ * portable path */
+#if defined(LIBJPEG_TURBO_VERSION_NUMBER) && LIBJPEG_TURBO_VERSION_NUMBER >= 1005000
+#define MJPEG_HAS_CROP 1
+#endif
+
+/** @internal
+ * @brief Point a decompressor at a frame and read its headers
+ *
+ * Errors longjmp to the caller's handler.
+ */
+static void mjpeg_read_header(struct jpeg_decompress_struct *dinfo,
+    const uint8_t *data, size_t data_bytes) {
+  JHUFF_TBL *dc_table = dinfo->dc_huff_tbl_ptrs[0];
+
+  /* Tables outlive the image that defined them. Blank the first one so a
+   * frame that carries no DHT of its own still gets the standard tables
+   * rather than the previous frame's. */
+  if (dc_table)
+    memset(dc_table->bits, 0, sizeof(dc_table->bits));
 
-  if (dinfo.dc_huff_tbl_ptrs[0] == NULL) {
+  jpeg_mem_src(dinfo, (const unsigned char*)data, data_bytes);
+  jpeg_read_header(dinfo, TRUE);
+
+  dc_table = dinfo->dc_huff_tbl_ptrs[0];
+  if (dc_table == NULL || huff_table_empty(dc_table)) {
     /* This frame is missing the Huffman tables: fill in the standard ones */
-    insert_huff_tables(&dinfo);
+    insert_huff_tables(dinfo);
   }
+}
+
+/** @internal
+ * @brief Read a target's crop region of a started decompression
+ *
+ * Rows below the region are left unread. Errors longjmp to the caller's
+ * handler.
+ */
+static void mjpeg_read_region(struct jpeg_decompress_struct *dinfo,
+    const struct mjpeg_target *target) {
+  size_t bytes_per_pixel = dinfo->output_components;
+  JDIMENSION end = target->y + target->height;
+  JDIMENSION left = target->x;
+  JSAMPARRAY rows;
+
+#ifdef MJPEG_HAS_CROP
+  JDIMENSION crop_right = target->x + target->width;
+  JDIMENSION crop_width;
 
-  if (out->frame_format == UVC_FRAME_FORMAT_RGB)
-    dinfo.out_color_space = JCS_RGB;
-  else if (out->frame_format == UVC_FRAME_FORMAT_GRAY8)
-    dinfo.out_color_space = JCS_GRAYSCALE;
-  else
+  /* Fancy upsampling treats the window's edges as the image's, so leave
+   * a pixel of context on each side for the region's chroma. libjpeg
+   * then widens the window to whole iMCU columns and moves left back to
+   * where the decoded rows now start. */
+  if (left > 0)
+    --left;
+  if (crop_right < dinfo->output_width)
+    ++crop_right;
+  crop_width = crop_right - left;
+  jpeg_crop_scanline(dinfo, &left, &crop_width);
+  left = target->x - left;
+
+  /* Skipped rows are entropy decoded but not transformed or converted */
+  if (target->y)
+    jpeg_skip_scanlines(dinfo, target->y);
+#endif
+
+  rows = (*dinfo->mem->alloc_sarray)((j_common_ptr) dinfo, JPOOL_IMAGE,
+      dinfo->output_width * bytes_per_pixel, MJPEG_ROWS_PER_READ);
+
+  while (dinfo->output_scanline < end) {
+    JDIMENSION first = dinfo->output_scanline;
+    JDIMENSION num_rows = end - first;
+
+    /* Without jpeg_skip_scanlines(), rows above the region are decoded
+     * and dropped */
+    if (first < (JDIMENSION) target->y)
+      num_rows = target->y - first;
+    if (num_rows > MJPEG_ROWS_PER_READ)
+      num_rows = MJPEG_ROWS_PER_READ;
+
+    num_rows = jpeg_read_scanlines(dinfo, rows, num_rows);
+
+    for (JDIMENSION i = 0; i < num_rows; ++i) {
+      JDIMENSION row = first + i;
+
+      if (row >= (JDIMENSION) target->y) {
+        memcpy(target->data + (row - target->y) * target->step,
+            rows[i] + left * bytes_per_pixel, target->width * bytes_per_pixel);
+      }
+    }
+  }
+}
+
+/** @internal
+ * @brief Decode a JPEG image into a target buffer
+ */
+static uvc_error_t mjpeg_decode(uvc_mjpeg_decoder_t *dec, const uint8_t *data,
+    size_t data_bytes, const struct mjpeg_target *target) {
+  struct jpeg_decompress_struct *dinfo = &dec->dinfo;
+  JSAMPROW rows[MJPEG_ROWS_PER_READ];
+
+  if (setjmp(dec->jerr.jmp)) {
     goto fail;
+  }
+
+  mjpeg_read_header(dinfo, data, data_bytes);
 
-  dinfo.dct_method = JDCT_IFAST;
+  dinfo->out_color_space = target->color_space;
+  dinfo->dct_method = JDCT_IFAST;
+  dinfo->scale_num = 1;
+  dinfo->scale_denom = target->scale_denom;
 
-  jpeg_start_decompress(&dinfo);
+  jpeg_start_decompress(dinfo);
 
-  lines_read = 0;
-  while (dinfo.output_scanline < dinfo.output_height) {
-    unsigned char *buffer[1] = {( unsigned char*) out->data + lines_read * out->step };
-    int num_scanlines;
+  if (target->crop) {
+    if ((JDIMENSION) (target->x + target->width) > dinfo->output_width ||
+        (JDIMENSION) (target->y + target->height) > dinfo->output_height)
+      goto fail;
 
-    num_scanlines = jpeg_read_scanlines(&dinfo, buffer, 1);
-    lines_read += num_scanlines;
+    mjpeg_read_region(dinfo, target);
+
+    /* Done without decoding the rows below the region */
+    jpeg_abort_decompress(dinfo);
+    return UVC_SUCCESS;
   }
 
-  jpeg_finish_decompress(&dinfo);
-  jpeg_destroy_decompress(&dinfo);
+  if ((int) dinfo->output_width > target->width ||
+      (int) dinfo->output_height > target->height)
+    goto fail;
+
+  /* Point libjpeg at whole MCU rows of the output at once; it returns as
+   * many rows as one pass of its upsampler and color converter yields */
+  while (dinfo->output_scanline < dinfo->output_height) {
+    JDIMENSION first = dinfo->output_scanline;
+    JDIMENSION num_rows = dinfo->output_height - first;
+
+    if (num_rows > MJPEG_ROWS_PER_READ)
+      num_rows = MJPEG_ROWS_PER_READ;
+    for (JDIMENSION i = 0; i < num_rows; ++i)
+      rows[i] = target->data + (first + i) * target->step;
+
+    jpeg_read_scanlines(dinfo, rows, num_rows);
+  }
+
+  jpeg_finish_decompress(dinfo);
   return UVC_SUCCESS;
 
 fail:
-  jpeg_destroy_decompress(&dinfo);
+  /* Back to the start state; the decompressor stays usable */
+  jpeg_abort_decompress(dinfo);
   return UVC_ERROR_OTHER;
 }
 
-/** @brief Convert an MJPEG frame to RGB
+/* Size of a component's blocks once decoded; smaller than DCTSIZE when
+ * scaling. libjpeg 7 and later scale each direction separately. */
+#if JPEG_LIB_VERSION >= 70
+#define MJPEG_DCT_WIDTH(comp) ((comp)->DCT_h_scaled_size)
+#define MJPEG_DCT_HEIGHT(comp) ((comp)->DCT_v_scaled_size)
+#else
+#define MJPEG_DCT_WIDTH(comp) ((comp)->DCT_scaled_size)
+#define MJPEG_DCT_HEIGHT(comp) ((comp)->DCT_scaled_size)
+#endif
+
+/** Planes a YUV 4:2:0 decode writes to */
+struct mjpeg_yuv_target {
+  uint8_t *y;
+  size_t y_step;
+  uint8_t *u;
+  uint8_t *v;
+  size_t uv_step;
+  /** Bytes from one chroma sample to the next: 1 for I420, 2 for NV12 */
+  size_t uv_pixel_step;
+  /** Largest image that fits the planes */
+  int width;
+  int height;
+  /** Decode at 1/scale_denom of the coded size: 1, 2, 4 or 8 */
+  int scale_denom;
+};
+
+/** @internal
+ * @brief Reduce one or two rows of a decoded chroma component to a 4:2:0 row
+ *
+ * @param a,b Source rows averaged together; the same row when the component
+ *   is already vertically subsampled
+ * @param src_width Samples in a source row
+ * @param fx 1 if the component is horizontally subsampled, 2 if not
+ */
+static void mjpeg_chroma_row(const JSAMPLE *a, const JSAMPLE *b, int src_width,
+    int fx, uint8_t *out, size_t pixel_step, int width) {
+  if (fx == 1) {
+    if (a == b && pixel_step == 1) {
+      memcpy(out, a, width);
+    } else if (a == b) {
+      for (int x = 0; x < width; ++x)
+        out[x * pixel_step] = a[x];
+    } else {
+      for (int x = 0; x < width; ++x)
+        out[x * pixel_step] = (uint8_t) ((a[x] + b[x] + 1) >> 1);
+    }
+  } else {
+    for (int x = 0; x < width; ++x) {
+      int x0 = 2 * x, x1 = x0 + 1 < src_width ? x0 + 1 : x0;
+      out[x * pixel_step] = (uint8_t) ((a[x0] + a[x1] + b[x0] + b[x1] + 2) >> 2);
+    }
+  }
+}
+
+/** @internal
+ * @brief Decode a JPEG image to YUV 4:2:0 planes
+ *
+ * Uses libjpeg's raw data output: the decoded Y, Cb and Cr components
+ * come back at their coded resolution, with no upsampling or color
+ * conversion. 4:2:0 chroma is copied as is; 4:2:2 and 4:4:4 chroma is
+ * averaged down to 4:2:0. Grayscale images get neutral chroma.
+ */
+static uvc_error_t mjpeg_decode_yuv(uvc_mjpeg_decoder_t *dec, const uint8_t *data,
+    size_t data_bytes, const struct mjpeg_yuv_target *target) {
+  struct jpeg_decompress_struct *dinfo = &dec->dinfo;
+  jpeg_component_info *comp;
+  JSAMPARRAY planes[3];
+  int fx, fy, luma_rows, chroma_rows, reads;
+  int width, height, uv_width, uv_height;
+
+  if (setjmp(dec->jerr.jmp)) {
+    goto fail;
+  }
+
+  mjpeg_read_header(dinfo, data, data_bytes);
+
+  if (dinfo->num_components != 1 &&
+      (dinfo->num_components != 3 || dinfo->jpeg_color_space != JCS_YCbCr))
+    goto unsupported;
+
+  dinfo->raw_data_out = TRUE;
+  dinfo->dct_method = JDCT_IFAST;
+  dinfo->scale_num = 1;
+  dinfo->scale_denom = target->scale_denom;
+
+  jpeg_start_decompress(dinfo);
+
+  width = (int) dinfo->output_width;
+  height = (int) dinfo->output_height;
+  uv_width = (width + 1) / 2;
+  uv_height = (height + 1) / 2;
+
+  if (width > target->width || height > target->height)
+    goto fail;
+
+  /* Sample rows and columns per MCU of each component, after scaling */
+  comp = dinfo->comp_info;
+  luma_rows = comp[0].v_samp_factor * MJPEG_DCT_HEIGHT(&comp[0]);
+  if (comp[0].v_samp_factor != dinfo->max_v_samp_factor)
+    goto unsupported;
+
+  /* Assigned here rather than initialised, so they are not live across
+   * setjmp and longjmp cannot clobber them */
+  fx = fy = 1;
+  chroma_rows = 0;
+  if (dinfo->num_components == 3) {
+    int luma_cols = comp[0].h_samp_factor * MJPEG_DCT_WIDTH(&comp[0]);
+    int chroma_cols = comp[1].h_samp_factor * MJPEG_DCT_WIDTH(&comp[1]);
+
+    chroma_rows = comp[1].v_samp_factor * MJPEG_DCT_HEIGHT(&comp[1]);
+    if (comp[2].h_samp_factor * MJPEG_DCT_WIDTH(&comp[2]) != chroma_cols ||
+        comp[2].v_samp_factor * MJPEG_DCT_HEIGHT(&comp[2]) != chroma_rows ||
+        (luma_cols != chroma_cols && luma_cols != 2 * chroma_cols) ||
+        (luma_rows != chroma_rows && luma_rows != 2 * chroma_rows))
+      goto unsupported;
+
+    fx = 2 * chroma_cols / luma_cols;
+    fy = 2 * chroma_rows / luma_rows;
+  }
+
+  /* At 1/8 scale a 4:2:2 image has a single chroma row per MCU row, so
+   * read MCU rows in pairs to keep each vertical pair of chroma rows in
+   * the buffer together */
+  reads = fy == 2 && chroma_rows % 2 ? 2 : 1;
+
+  /* Each read returns one row of MCUs of each component, padded out to
+   * whole blocks */
+  for (int c = 0; c < dinfo->num_components; ++c) {
+    planes[c] = (*dinfo->mem->alloc_sarray)((j_common_ptr) dinfo, JPOOL_IMAGE,
+        comp[c].width_in_blocks * MJPEG_DCT_WIDTH(&comp[c]),
+        comp[c].v_samp_factor * MJPEG_DCT_HEIGHT(&comp[c]) * reads);
+  }
+
+  for (int group = 0; dinfo->output_scanline < dinfo->output_height; ++group) {
+    int y0 = group * reads * luma_rows;
+
+    for (int i = 0; i < reads && dinfo->output_scanline < dinfo->output_height; ++i) {
+      JSAMPARRAY rows[3];
+
+      for (int c = 0; c < dinfo->num_components; ++c)
+        rows[c] = planes[c] + i * comp[c].v_samp_factor * MJPEG_DCT_HEIGHT(&comp[c]);
+
+      jpeg_read_raw_data(dinfo, rows, luma_rows);
+    }
+
+    for (int r = 0; r < reads * luma_rows && y0 + r < height; ++r)
+      memcpy(target->y + (y0 + r) * target->y_step, planes[0][r], width);
+
+    if (!chroma_rows)
+      continue;
+
+    int c0 = group * reads * chroma_rows;
+    int c1 = c0 + reads * chroma_rows;
+    int src_height = (int) comp[1].downsampled_height;
+    int src_width = (int) comp[1].downsampled_width;
+
+    for (int oy = c0 / fy; oy < c1 / fy && oy < uv_height; ++oy) {
+      int a = oy * fy - c0;
+      int b = oy * fy + fy - 1 < src_height ? a + fy - 1 : a;
+      size_t offset = oy * target->uv_step;
+
+      mjpeg_chroma_row(planes[1][a], planes[1][b], src_width, fx,
+          target->u + offset, target->uv_pixel_step, uv_width);
+      mjpeg_chroma_row(planes[2][a], planes[2][b], src_width, fx,
+          target->v + offset, target->uv_pixel_step, uv_width);
+    }
+  }
+
+  jpeg_finish_decompress(dinfo);
+
+  if (!chroma_rows) {
+    for (int oy = 0; oy < uv_height; ++oy) {
+      uint8_t *u = target->u + oy * target->uv_step;
+      uint8_t *v = target->v + oy * target->uv_step;
+
+      for (int x = 0; x < uv_width; ++x) {
+        u[x * target->uv_pixel_step] = 128;
+        v[x * target->uv_pixel_step] = 128;
+      }
+    }
+  }
+
+  return UVC_SUCCESS;
+
+unsupported:
+  jpeg_abort_decompress(dinfo);
+  return UVC_ERROR_NOT_SUPPORTED;
+
+fail:
+  /* Back to the start state; the decompressor stays usable */
+  jpeg_abort_decompress(dinfo);
+  return UVC_ERROR_OTHER;
+}
+
+/** @internal
+ * @brief Layout of a baseline JPEG with restart markers
+ *
+ * Each restart interval is entropy coded independently, so an interval
+ * that begins a row of MCUs can start a JPEG of its own: the original
+ * headers with a smaller frame height, the intervals up to the next cut
+ * (restart markers renumbered from RST0) and an EOI.
+ */
+struct mjpeg_restarts {
+  /** Offset of the 16-bit image height in the SOF segment */
+  size_t sof_height;
+  /** First byte of entropy-coded data */
+  size_t scan_start;
+  /** End of entropy-coded data (the EOI marker, if present) */
+  size_t scan_end;
+  /** Offset of every RSTn marker, in stream order */
+  std::vector<size_t> markers;
+  int width;
+  int height;
+  int mcu_height;
+  int mcus_per_row;
+  int mcu_rows;
+  int interval;
+};
+
+/** @internal
+ * @brief Find the restart intervals of a JPEG image
+ *
+ * @return 1 if the image can be decoded in row stripes, 0 otherwise
+ */
+static int mjpeg_find_restarts(const uint8_t *p, size_t size, struct mjpeg_restarts *rst) {
+  size_t pos = 2;
+  int num_comps = 0, h_max = 1, v_max = 1, v_min = 4;
+
+  if (size < 4 || p[0] != 0xff || p[1] != 0xd8)
+    return 0;
+
+  rst->interval = 0;
+  rst->sof_height = 0;
+
+  for (;;) {
+    uint8_t marker;
+    size_t len;
+
+    if (pos + 4 > size || p[pos] != 0xff)
+      return 0;
+
+    marker = p[pos + 1];
+    if (marker == 0xff) {
+      ++pos;
+      continue;
+    }
+    if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd8)) {
+      pos += 2;
+      continue;
+    }
+
+    len = (p[pos + 2] << 8) | p[pos + 3];
+    if (len < 2 || pos + 2 + len > size)
+      return 0;
+
+    const uint8_t *seg = p + pos + 4;
+
+    if (marker == 0xc0 || marker == 0xc1) {
+      /* Baseline or extended sequential Huffman */
+      if (len < 8)
+        return 0;
+      rst->sof_height = pos + 5;
+      rst->height = (seg[1] << 8) | seg[2];
+      rst->width = (seg[3] << 8) | seg[4];
+      num_comps = seg[5];
+      if (num_comps < 1 || len < 8 + 3 * (size_t) num_comps)
+        return 0;
+      for (int c = 0; c < num_comps; ++c) {
+        int h = seg[7 + 3 * c] >> 4, v = seg[7 + 3 * c] & 15;
+        if (h > h_max) h_max = h;
+        if (v > v_max) v_max = v;
+        if (v < v_min) v_min = v;
+      }
+    } else if (marker >= 0xc2 && marker <= 0xcf &&
+               marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+      /* Progressive, lossless or arithmetic coded */
+      return 0;
+    } else if (marker == 0xdd) {
+      if (len < 4)
+        return 0;
+      rst->interval = (seg[0] << 8) | seg[1];
+    } else if (marker == 0xda) {
+      /* Only a single scan holding every component can be cut */
+      if (!rst->sof_height || seg[0] != num_comps)
+        return 0;
+      rst->scan_start = pos + 2 + len;
+      break;
+    } else if (marker == 0xd9) {
+      return 0;
+    }
+
+    pos += 2 + len;
+  }
+
+  /* Fancy upsampling of vertically subsampled chroma reads the rows on
+   * both sides of a cut, so such images would not decode identically */
+  if (!rst->interval || rst->width == 0 || rst->height == 0 || v_min != v_max)
+    return 0;
+
+  if (num_comps == 1)
+    h_max = v_max = 1;
+
+  rst->mcu_height = 8 * v_max;
+  rst->mcus_per_row = (rst->width + 8 * h_max - 1) / (8 * h_max);
+  rst->mcu_rows = (rst->height + rst->mcu_height - 1) / rst->mcu_height;
+
+  rst->markers.clear();
+  for (pos = rst->scan_start; pos + 1 < size; ) {
+    uint8_t marker;
+
+    if (p[pos] != 0xff) {
+      ++pos;
+      continue;
+    }
+
+    marker = p[pos + 1];
+    if (marker == 0x00) {
+      pos += 2;
+    } else if (marker == 0xff) {
+      ++pos;
+    } else if (marker >= 0xd0 && marker <= 0xd7) {
+      rst->markers.push_back(pos);
+      pos += 2;
+    } else {
+      break;
+    }
+  }
+  rst->scan_end = pos + 1 < size ? pos : size;
+
+  /* A truncated or padded scan would put the cuts in the wrong rows */
+  size_t num_mcus = (size_t) rst->mcus_per_row * rst->mcu_rows;
+  size_t num_intervals = (num_mcus + rst->interval - 1) / rst->interval;
+
+  return rst->markers.size() + 1 == num_intervals;
+}
+
+struct mjpeg_stripe_job {
+  /** Caller's decoder; pool workers use their own */
+  uvc_mjpeg_decoder_t *decoder;
+  std::thread::id caller;
+  const uint8_t *data;
+  struct mjpeg_restarts rst;
+  /** First restart interval of each stripe, plus the interval count */
+  std::vector<size_t> cuts;
+  struct mjpeg_target target;
+  std::atomic<int> failed;
+};
+
+static void mjpeg_decode_stripe(void *arg, int stripe, int) {
+  struct mjpeg_stripe_job *job = (struct mjpeg_stripe_job *) arg;
+  const struct mjpeg_restarts *rst = &job->rst;
+  size_t first = job->cuts[stripe], last = job->cuts[stripe + 1];
+  size_t num_intervals = rst->markers.size() + 1;
+  size_t data_start = first ? rst->markers[first - 1] + 2 : rst->scan_start;
+  size_t data_end = last < num_intervals ? rst->markers[last - 1] : rst->scan_end;
+  int row = (int) (first * rst->interval / rst->mcus_per_row) * rst->mcu_height;
+  int end_row = last < num_intervals ?
+      (int) (last * rst->interval / rst->mcus_per_row) * rst->mcu_height : rst->height;
+  std::vector<uint8_t> jpeg;
+
+  jpeg.reserve(rst->scan_start + (data_end - data_start) + 2);
+  jpeg.insert(jpeg.end(), job->data, job->data + rst->scan_start);
+  jpeg[rst->sof_height] = (uint8_t) ((end_row - row) >> 8);
+  jpeg[rst->sof_height + 1] = (uint8_t) (end_row - row);
+
+  jpeg.insert(jpeg.end(), job->data + data_start, job->data + data_end);
+  for (size_t i = first; i + 1 < last; ++i) {
+    size_t marker = rst->scan_start + (rst->markers[i] - data_start);
+    jpeg[marker + 1] = (uint8_t) (0xd0 + ((i - first) & 7));
+  }
+  jpeg.push_back(0xff);
+  jpeg.push_back(0xd9);
+
+  uvc_mjpeg_decoder_t *decoder = std::this_thread::get_id() == job->caller ?
+      job->decoder : thread_decoder();
+  struct mjpeg_target target = job->target;
+
+  /* Cuts fall on MCU rows, which stay whole rows of pixels when scaled */
+  target.data += row / target.scale_denom * target.step;
+  target.height = (end_row - row + target.scale_denom - 1) / target.scale_denom;
+
+  if (!decoder || mjpeg_decode(decoder, jpeg.data(), jpeg.size(), &target) != UVC_SUCCESS)
+    job->failed.store(1);
+}
+
+/** @internal
+ * @brief Decode in row stripes cut at restart markers, on the frame's pool
+ *
+ * @return 1 if the frame was decoded (successfully or not) in stripes,
+ *   0 if it has to be decoded in one piece
+ */
+static int mjpeg_convert_striped(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *in,
+    const struct mjpeg_target *target, uvc_error_t *ret) {
+  struct uvc_conv_pool *pool = _uvc_frame_conv_pool(in);
+  struct mjpeg_stripe_job job;
+  int num_stripes;
+
+  if (!pool || target->crop)
+    return 0;
+
+  if (!mjpeg_find_restarts((const uint8_t *) in->data, in->data_bytes, &job.rst) ||
+      MJPEG_SCALED(job.rst.width, target->scale_denom) != target->width ||
+      MJPEG_SCALED(job.rst.height, target->scale_denom) != target->height)
+    return 0;
+
+  /* Cut at the first row-aligned interval at or after each even share */
+  num_stripes = _uvc_conv_stripes(pool, job.rst.mcu_rows, 2);
+  job.cuts.push_back(0);
+  for (int i = 1; i < num_stripes; ++i) {
+    size_t target = (size_t) job.rst.mcu_rows * i / num_stripes * job.rst.mcus_per_row;
+    size_t cut = (target + job.rst.interval - 1) / job.rst.interval;
+
+    while (cut <= job.rst.markers.size() && (cut * job.rst.interval) % job.rst.mcus_per_row)
+      ++cut;
+    if (cut > job.rst.markers.size() || cut <= job.cuts.back())
+      continue;
+    job.cuts.push_back(cut);
+  }
+  job.cuts.push_back(job.rst.markers.size() + 1);
+
+  if (job.cuts.size() < 3)
+    return 0;
+
+  job.decoder = decoder;
+  job.caller = std::this_thread::get_id();
+  job.data = (const uint8_t *) in->data;
+  job.target = *target;
+  job.failed.store(0);
+
+  _uvc_conv_run(pool, (int) job.cuts.size() - 1, mjpeg_decode_stripe, &job);
+
+  *ret = job.failed.load() ? UVC_ERROR_OTHER : UVC_SUCCESS;
+  return 1;
+}
+
+static uvc_error_t uvc_mjpeg_convert(uvc_mjpeg_decoder_t *decoder,
+    uvc_frame_t *in, const struct mjpeg_target *target) {
+  uvc_error_t ret;
+
+  if (mjpeg_convert_striped(decoder, in, target, &ret))
+    return ret;
+
+  return mjpeg_decode(decoder, (const uint8_t *) in->data, in->data_bytes, target);
+}
+
+/** @internal
+ * @brief libjpeg color space and bytes per pixel of an output format
+ */
+static uvc_error_t mjpeg_output_format(enum uvc_frame_format format,
+    J_COLOR_SPACE *color_space, size_t *bytes_per_pixel) {
+  switch (format) {
+  case UVC_FRAME_FORMAT_RGB:
+    *color_space = JCS_RGB;
+    *bytes_per_pixel = 3;
+    return UVC_SUCCESS;
+  case UVC_FRAME_FORMAT_GRAY8:
+    *color_space = JCS_GRAYSCALE;
+    *bytes_per_pixel = 1;
+    return UVC_SUCCESS;
+  default:
+    return UVC_ERROR_NOT_SUPPORTED;
+  }
+}
+
+/** @internal
+ * @brief Decode an MJPEG frame to an I420 or NV12 frame
+ */
+static uvc_error_t mjpeg_decode_planar(uvc_mjpeg_decoder_t *decoder,
+    uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format format, int scale_denom) {
+  struct mjpeg_yuv_target target;
+  size_t width = MJPEG_SCALED(in->width, scale_denom);
+  size_t height = MJPEG_SCALED(in->height, scale_denom);
+  size_t uv_height = (height + 1) / 2;
+  size_t step = _uvc_out_step(out, width);
+  size_t uv_step = _uvc_chroma_step(format, step);
+  size_t y_bytes = step * height;
+
+  if (!step)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (uvc_ensure_frame_size(out, y_bytes + (format == UVC_FRAME_FORMAT_NV12 ? 1 : 2) *
+                                 uv_step * uv_height) < 0)
+    return UVC_ERROR_NO_MEM;
+
+  out->width = width;
+  out->height = height;
+  out->frame_format = format;
+  out->step = step;
+  out->sequence = in->sequence;
+  out->capture_time = in->capture_time;
+  out->capture_time_finished = in->capture_time_finished;
+  out->source = in->source;
+
+  target.y = (uint8_t *) out->data;
+  target.y_step = step;
+  target.u = target.y + y_bytes;
+  target.uv_step = uv_step;
+  target.width = width;
+  target.height = height;
+  target.scale_denom = scale_denom;
+
+  if (format == UVC_FRAME_FORMAT_NV12) {
+    target.v = target.u + 1;
+    target.uv_pixel_step = 2;
+  } else {
+    target.v = target.u + uv_step * uv_height;
+    target.uv_pixel_step = 1;
+  }
+
+  return mjpeg_decode_yuv(decoder, (const uint8_t *) in->data, in->data_bytes, &target);
+}
+
+/** @brief Decode an MJPEG frame with a reusable decoder
+ * @ingroup frame
+ *
+ * I420 and NV12 output skips libjpeg's upsampling and color conversion,
+ * which makes it markedly cheaper than RGB for consumers that want YUV.
+ * Frames are not checked with uvc_mjpeg_validate() first, so anything
+ * libjpeg can recover from still decodes.
+ *
+ * @param decoder Decoder from uvc_mjpeg_decoder_create()
+ * @param in MJPEG frame
+ * @param out Output frame
+ * @param format Output format: UVC_FRAME_FORMAT_RGB, UVC_FRAME_FORMAT_GRAY8,
+ *   UVC_FRAME_FORMAT_I420 or UVC_FRAME_FORMAT_NV12
+ */
+uvc_error_t uvc_mjpeg_decode(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *in,
+    uvc_frame_t *out, enum uvc_frame_format format) {
+  return uvc_mjpeg_decode_scaled(decoder, in, out, format, 1);
+}
+
+/** @brief Decode an MJPEG frame at reduced resolution
  * @ingroup frame
  *
+ * libjpeg scales in the inverse DCT, computing only the low-frequency
+ * coefficients each output pixel needs, so a 1/4 or 1/8 decode costs a
+ * fraction of a full one. Suited to previews and analytics that work on
+ * thumbnails. The output frame is (width / scale_denom) x
+ * (height / scale_denom), rounded up.
+ *
+ * @param decoder Decoder from uvc_mjpeg_decoder_create()
  * @param in MJPEG frame
- * @param out RGB frame
+ * @param out Output frame
+ * @param format Output format, as for uvc_mjpeg_decode()
+ * @param scale_denom 1, 2, 4 or 8
  */
-uvc_error_t uvc_mjpeg2rgb(uvc_frame_t *in, uvc_frame_t *out) {
+uvc_error_t uvc_mjpeg_decode_scaled(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *in,
+    uvc_frame_t *out, enum uvc_frame_format format, int scale_denom) {
+  struct mjpeg_target target;
+  size_t bytes_per_pixel, width, height, step;
+  uvc_error_t ret;
+
   if (in->frame_format != UVC_FRAME_FORMAT_MJPEG)
     return UVC_ERROR_INVALID_PARAM;
 
-  if (uvc_ensure_frame_size(out, in->width * in->height * 3) < 0)
+  if (scale_denom != 1 && scale_denom != 2 && scale_denom != 4 && scale_denom != 8)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (format == UVC_FRAME_FORMAT_I420 || format == UVC_FRAME_FORMAT_NV12)
+    return mjpeg_decode_planar(decoder, in, out, format, scale_denom);
+
+  ret = mjpeg_output_format(format, &target.color_space, &bytes_per_pixel);
+  if (ret != UVC_SUCCESS)
+    return ret;
+
+  width = MJPEG_SCALED(in->width, scale_denom);
+  height = MJPEG_SCALED(in->height, scale_denom);
+  step = _uvc_out_step(out, width * bytes_per_pixel);
+
+  if (!step)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (_uvc_ensure_frame_rows(out, step, width * bytes_per_pixel, height) < 0)
     return UVC_ERROR_NO_MEM;
 
-  out->width = in->width;
-  out->height = in->height;
-  out->frame_format = UVC_FRAME_FORMAT_RGB;
-  out->step = in->width * 3;
+  out->width = width;
+  out->height = height;
+  out->frame_format = format;
+  out->step = step;
   out->sequence = in->sequence;
   out->capture_time = in->capture_time;
   out->capture_time_finished = in->capture_time_finished;
   out->source = in->source;
 
-  return uvc_mjpeg_convert(in, out);
+  target.data = (uint8_t *) out->data;
+  target.step = out->step;
+  target.width = width;
+  target.height = height;
+  target.scale_denom = scale_denom;
+  target.crop = 0;
+
+  return uvc_mjpeg_convert(decoder, in, &target);
 }
 
-/** @brief Convert an MJPEG frame to GRAY8
+/** @brief Decode an MJPEG frame straight into a caller's strided buffer
  * @ingroup frame
  *
+ * Rows are written @p step bytes apart, so the image can land in a
+ * padded buffer or a sub-rectangle of a larger one (a GPU staging
+ * buffer, an aligned image plane) without a repacking copy.
+ *
+ * @param decoder Decoder from uvc_mjpeg_decoder_create()
  * @param in MJPEG frame
- * @param out GRAY8 frame
+ * @param data First byte of the top output row
+ * @param data_bytes Bytes available from @p data on
+ * @param step Bytes from one output row to the next
+ * @param format Output format: UVC_FRAME_FORMAT_RGB or UVC_FRAME_FORMAT_GRAY8
  */
-uvc_error_t uvc_mjpeg2gray(uvc_frame_t *in, uvc_frame_t *out) {
+uvc_error_t uvc_mjpeg_decode_buffer(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *in,
+    void *data, size_t data_bytes, size_t step, enum uvc_frame_format format) {
+  struct mjpeg_target target;
+  size_t bytes_per_pixel;
+  uvc_error_t ret;
+
+  if (in->frame_format != UVC_FRAME_FORMAT_MJPEG || !in->width || !in->height)
+    return UVC_ERROR_INVALID_PARAM;
+
+  ret = mjpeg_output_format(format, &target.color_space, &bytes_per_pixel);
+  if (ret != UVC_SUCCESS)
+    return ret;
+
+  if (step < in->width * bytes_per_pixel ||
+      data_bytes < step * (in->height - 1) + in->width * bytes_per_pixel)
+    return UVC_ERROR_INVALID_PARAM;
+
+  target.data = (uint8_t *) data;
+  target.step = step;
+  target.width = in->width;
+  target.height = in->height;
+  target.scale_denom = 1;
+  target.crop = 0;
+
+  return uvc_mjpeg_convert(decoder, in, &target);
+}
+
+/** @brief Decode a rectangle of an MJPEG frame
+ * @ingroup frame
+ *
+ * Only the requested region is converted. With libjpeg-turbo 2.0 or
+ * later, columns outside it are cropped away (to the nearest MCU) and the
+ * rows above it are skipped without being transformed; other libjpeg
+ * builds decode and drop the rows above the region. Either way, rows
+ * below the region are never decoded.
+ *
+ * @param decoder Decoder from uvc_mjpeg_decoder_create()
+ * @param in MJPEG frame
+ * @param out Output frame, sized to the region
+ * @param format Output format: UVC_FRAME_FORMAT_RGB or UVC_FRAME_FORMAT_GRAY8
+ * @param x Left edge of the region
+ * @param y Top edge of the region
+ * @param width Width of the region
+ * @param height Height of the region
+ */
+uvc_error_t uvc_mjpeg_decode_roi(uvc_mjpeg_decoder_t *decoder, uvc_frame_t *in,
+    uvc_frame_t *out, enum uvc_frame_format format,
+    int x, int y, int width, int height) {
+  struct mjpeg_target target;
+  size_t bytes_per_pixel, step;
+  uvc_error_t ret;
+
   if (in->frame_format != UVC_FRAME_FORMAT_MJPEG)
     return UVC_ERROR_INVALID_PARAM;
 
-  if (uvc_ensure_frame_size(out, in->width * in->height) < 0)
+  if (x < 0 || y < 0 || width <= 0 || height <= 0 ||
+      (uint32_t) x + width > in->width || (uint32_t) y + height > in->height)
+    return UVC_ERROR_INVALID_PARAM;
+
+  ret = mjpeg_output_format(format, &target.color_space, &bytes_per_pixel);
+  if (ret != UVC_SUCCESS)
+    return ret;
+
+  step = _uvc_out_step(out, width * bytes_per_pixel);
+  if (!step)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (_uvc_ensure_frame_rows(out, step, width * bytes_per_pixel, height) < 0)
     return UVC_ERROR_NO_MEM;
 
-  out->width = in->width;
-  out->height = in->height;
-  out->frame_format = UVC_FRAME_FORMAT_GRAY8;
-  out->step = in->width;
+  out->width = width;
+  out->height = height;
+  out->frame_format = format;
+  out->step = step;
   out->sequence = in->sequence;
   out->capture_time = in->capture_time;
   out->capture_time_finished = in->capture_time_finished;
   out->source = in->source;
 
-  return uvc_mjpeg_convert(in, out);
+  target.data = (uint8_t *) out->data;
+  target.step = out->step;
+  target.width = width;
+  target.height = height;
+  target.scale_denom = 1;
+  target.crop = 1;
+  target.x = x;
+  target.y = y;
+
+  return uvc_mjpeg_convert(decoder, in, &target);
+}
+
+/** @brief Convert an MJPEG frame to RGB
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out RGB frame
+ */
+uvc_error_t uvc_mjpeg2rgb(uvc_frame_t *in, uvc_frame_t *out) {
+  uvc_mjpeg_decoder_t *decoder = thread_decoder();
+
+  if (!decoder)
+    return UVC_ERROR_NO_MEM;
+
+  return uvc_mjpeg_decode(decoder, in, out, UVC_FRAME_FORMAT_RGB);
+}
+
+/** @brief Convert an MJPEG frame to GRAY8
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out GRAY8 frame
+ */
+uvc_error_t uvc_mjpeg2gray(uvc_frame_t *in, uvc_frame_t *out) {
+  uvc_mjpeg_decoder_t *decoder = thread_decoder();
+
+  if (!decoder)
+    return UVC_ERROR_NO_MEM;
+
+  return uvc_mjpeg_decode(decoder, in, out, UVC_FRAME_FORMAT_GRAY8);
+}
+
+/** @brief Convert an MJPEG frame to I420
+ * @ingroup frame
+ *
+ * Chroma is taken straight from the JPEG's decoded components, so no RGB
+ * intermediate is produced.
+ *
+ * @param in MJPEG frame
+ * @param out I420 frame
+ */
+uvc_error_t uvc_mjpeg2i420(uvc_frame_t *in, uvc_frame_t *out) {
+  uvc_mjpeg_decoder_t *decoder = thread_decoder();
+
+  if (!decoder)
+    return UVC_ERROR_NO_MEM;
+
+  return uvc_mjpeg_decode(decoder, in, out, UVC_FRAME_FORMAT_I420);
+}
+
+/** @brief Convert an MJPEG frame to NV12
+ * @ingroup frame
+ *
+ * @param in MJPEG frame
+ * @param out NV12 frame
+ */
+uvc_error_t uvc_mjpeg2nv12(uvc_frame_t *in, uvc_frame_t *out) {
+  uvc_mjpeg_decoder_t *decoder = thread_decoder();
+
+  if (!decoder)
+    return UVC_ERROR_NO_MEM;
+
+  return uvc_mjpeg_decode(decoder, in, out, UVC_FRAME_FORMAT_NV12);
 }
@@ -0,0 +1,1187 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (C) 2010-2012 Ken Tossell
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the author nor other contributors may be
+*     used to endorse or promote products derived from this software
+*     without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+/**
+ * @internal
+ * @file frame-simd.cpp
+ * @brief Vectorized color conversion kernels with runtime dispatch
+ *
+ * Every kernel computes exactly what the scalar reference does:
+ *
+ *   r = (22987 * (V - 128)) >> 14
+ *   g = (-5636 * (U - 128) - 11698 * (V - 128)) >> 14
+ *   b = (29049 * (U - 128)) >> 14
+ *
+ * followed by a [0, 255] clamp of Y + r/g/b. The products are formed in
+ * 32 bits and shifted arithmetically, so the vector paths are bit-exact
+ * with the scalar one.
+ */
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define UVC_SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define UVC_SIMD_ARM 1
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define UVC_TARGET(isa)
+#else
+#define UVC_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+static inline unsigned char sat(int i) {
+  return (unsigned char)( i >= 255 ? 255 : (i < 0 ? 0 : i));
+}
+
+/** @internal
+ * @brief Convert two pixels sharing a chroma pair
+ */
+template <bool bgr>
+static inline void yuv_pair_to_rgb24(int y0, int y1, int u, int v, uint8_t *out) {
+  int r = (22987 * (v - 128)) >> 14;
+  int g = (-5636 * (u - 128) - 11698 * (v - 128)) >> 14;
+  int b = (29049 * (u - 128)) >> 14;
+
+  out[bgr ? 2 : 0] = sat(y0 + r);
+  out[1] = sat(y0 + g);
+  out[bgr ? 0 : 2] = sat(y0 + b);
+  out[bgr ? 5 : 3] = sat(y1 + r);
+  out[4] = sat(y1 + g);
+  out[bgr ? 3 : 5] = sat(y1 + b);
+}
+
+/** @internal
+ * @brief Scalar reference; also converts the tail the vector loops leave
+ */
+template <bool uyvy, bool bgr>
+static void yuv422_to_rgb24_c(const uint8_t *in, uint8_t *out, size_t pixels) {
+  for (; pixels >= 2; pixels -= 2, in += 4, out += 6)
+    yuv_pair_to_rgb24<bgr>(in[uyvy ? 1 : 0], in[uyvy ? 3 : 2],
+                           in[uyvy ? 0 : 1], in[uyvy ? 2 : 3], out);
+}
+
+/** @internal
+ * @brief Scalar NV12 reference: a row of Y and its row of U,V pairs
+ */
+template <bool bgr>
+static void nv12_to_rgb24_c(const uint8_t *y, const uint8_t *uv, uint8_t *out, size_t pixels) {
+  for (; pixels >= 2; pixels -= 2, y += 2, uv += 2, out += 6)
+    yuv_pair_to_rgb24<bgr>(y[0], y[1], uv[0], uv[1], out);
+}
+
+/** @internal
+ * @brief Scalar 4:2:2 to 4:2:0 reference: two rows in, chroma averaged
+ */
+template <bool uyvy, bool nv12>
+static void yuv422_to_420_c(const uint8_t *r0, const uint8_t *r1, uint8_t *y0, uint8_t *y1,
+    uint8_t *u, uint8_t *v, size_t pixels) {
+  const int yo = uyvy ? 1 : 0, uo = uyvy ? 0 : 1;
+
+  for (; pixels >= 2; pixels -= 2, r0 += 4, r1 += 4, y0 += 2, y1 += 2) {
+    uint8_t cu = (uint8_t) ((r0[uo] + r1[uo] + 1) >> 1);
+    uint8_t cv = (uint8_t) ((r0[uo + 2] + r1[uo + 2] + 1) >> 1);
+
+    y0[0] = r0[yo];
+    y0[1] = r0[yo + 2];
+    y1[0] = r1[yo];
+    y1[1] = r1[yo + 2];
+    if (nv12) {
+      u[0] = cu;
+      u[1] = cv;
+      u += 2;
+    } else {
+      *u++ = cu;
+      *v++ = cv;
+    }
+  }
+}
+
+/** @internal
+ * @brief Scalar 4:2:2 luma extraction reference
+ */
+template <bool uyvy>
+static void yuv422_to_y_c(const uint8_t *in, uint8_t *out, size_t pixels) {
+  for (in += uyvy ? 1 : 0; pixels > 0; --pixels, in += 2, ++out)
+    *out = *in;
+}
+
+static void gray_to_rgb24_c(const uint8_t *in, uint8_t *out, size_t pixels) {
+  for (; pixels > 0; --pixels, ++in, out += 3)
+    out[0] = out[1] = out[2] = *in;
+}
+
+/** @internal
+ * @brief Scalar 16-to-8-bit gray reference: clamp((v - offset) >> shift)
+ */
+static void gray16_to_gray8_c(const uint8_t *in, uint8_t *out, size_t pixels,
+    int shift, uint16_t offset) {
+  for (; pixels > 0; --pixels, in += 2, ++out) {
+    int v = in[0] | (in[1] << 8);
+
+    v = v > offset ? (v - offset) >> shift : 0;
+    *out = v > 255 ? 255 : v;
+  }
+}
+
+/** @internal
+ * @brief Scalar bilinear demosaic of columns [x, end) of a Bayer row
+ *
+ * A row holds its own colour (red or blue) on one parity of columns and
+ * green on the other; the rows above and below hold green and the other
+ * colour. At an own-colour site, green is the mean of the four adjacent
+ * pixels and the other colour that of the four diagonal ones. At a green
+ * site, the own colour is the mean of the left and right pixels and the
+ * other colour that of the pixels above and below. The first and last
+ * columns mirror their neighbour.
+ */
+template <bool bgr>
+static void bayer_span_c(const uint8_t *u, const uint8_t *c, const uint8_t *d,
+    uint8_t *out, size_t width, size_t x, size_t end, int g_first, int red_row) {
+  for (; x < end; ++x) {
+    size_t l = x > 0 ? x - 1 : x + 1;
+    size_t r = x + 1 < width ? x + 1 : x - 1;
+    int own, green, other;
+
+    if ((int) (x & 1) == g_first) {
+      own = c[x];
+      green = (c[l] + c[r] + u[x] + d[x] + 2) >> 2;
+      other = (u[l] + u[r] + d[l] + d[r] + 2) >> 2;
+    } else {
+      own = (c[l] + c[r] + 1) >> 1;
+      green = c[x];
+      other = (u[x] + d[x] + 1) >> 1;
+    }
+
+    out[3 * x + (bgr ? 2 : 0)] = red_row ? own : other;
+    out[3 * x + 1] = green;
+    out[3 * x + (bgr ? 0 : 2)] = red_row ? other : own;
+  }
+}
+
+/** @internal
+ * @brief Scalar bilinear demosaic of a Bayer row; see uvc_bayer_rgb_fn
+ */
+template <bool bgr>
+static void bayer_to_rgb24_c(const uint8_t *u, const uint8_t *c, const uint8_t *d,
+    uint8_t *out, size_t width, int pattern) {
+  bayer_span_c<bgr>(u, c, d, out, width, 0, width, pattern & 1, (pattern >> 1) & 1);
+}
+
+#ifdef UVC_SIMD_X86
+
+/* pshufb masks that scatter 16 bytes of one channel into the three 16-byte
+ * chunks of 48 bytes of packed 24-bit pixels. Row c*3 + j holds channel c's
+ * contribution to chunk j. */
+static const int8_t rgb24_interleave[9][16] = {
+  {  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1,  5 },
+  { -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10, -1 },
+  { -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1 },
+  { -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1 },
+  {  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10 },
+  { -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1 },
+  { -1, -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1 },
+  { -1,  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1 },
+  { 10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15 },
+};
+
+/** Coefficient pair for _mm_madd_epi16 over interleaved (U, V) lanes */
+static inline int32_t uv_coef(int16_t cu, int16_t cv) {
+  return (int32_t)(((uint32_t)(uint16_t)cv << 16) | (uint16_t)cu);
+}
+
+/** @internal
+ * @brief Load the pshufb masks of rgb24_interleave
+ */
+UVC_TARGET("ssse3")
+static inline void load_interleave_ssse3(__m128i shuf[9]) {
+  for (int i = 0; i < 9; ++i)
+    shuf[i] = _mm_loadu_si128((const __m128i *) rgb24_interleave[i]);
+}
+
+/** @internal
+ * @brief Interleave three channels of 16 pixels into 48 bytes
+ */
+UVC_TARGET("ssse3")
+static inline void store_rgb24_ssse3(__m128i c0, __m128i c1, __m128i c2,
+    const __m128i shuf[9], uint8_t *out) {
+  for (int j = 0; j < 3; ++j) {
+    __m128i o = _mm_or_si128(
+        _mm_or_si128(_mm_shuffle_epi8(c0, shuf[j]), _mm_shuffle_epi8(c1, shuf[3 + j])),
+        _mm_shuffle_epi8(c2, shuf[6 + j]));
+    _mm_storeu_si128((__m128i *) (out + 16 * j), o);
+  }
+}
+
+/** @internal
+ * @brief Convert 16 pixels of YUV to 24-bit RGB/BGR
+ *
+ * @p ya and @p yb hold the Y of pixels 0-7 and 8-15 as 16-bit lanes, @p ca
+ * and @p cb the U,V,U,V... of the same pixels, one pair per two pixels.
+ */
+template <bool bgr>
+UVC_TARGET("ssse3")
+static inline void yuv_to_rgb24_ssse3(__m128i ya, __m128i yb, __m128i ca, __m128i cb,
+    const __m128i shuf[9], uint8_t *out) {
+  const __m128i bias = _mm_set1_epi16(128);
+  const __m128i coef_r = _mm_set1_epi32(uv_coef(0, 22987));
+  const __m128i coef_g = _mm_set1_epi32(uv_coef(-5636, -11698));
+  const __m128i coef_b = _mm_set1_epi32(uv_coef(29049, 0));
+
+  ca = _mm_sub_epi16(ca, bias);
+  cb = _mm_sub_epi16(cb, bias);
+
+  /* One 16-bit term per chroma pair (8 pairs) */
+  __m128i r = _mm_packs_epi32(
+      _mm_srai_epi32(_mm_madd_epi16(ca, coef_r), 14),
+      _mm_srai_epi32(_mm_madd_epi16(cb, coef_r), 14));
+  __m128i g = _mm_packs_epi32(
+      _mm_srai_epi32(_mm_madd_epi16(ca, coef_g), 14),
+      _mm_srai_epi32(_mm_madd_epi16(cb, coef_g), 14));
+  __m128i bl = _mm_packs_epi32(
+      _mm_srai_epi32(_mm_madd_epi16(ca, coef_b), 14),
+      _mm_srai_epi32(_mm_madd_epi16(cb, coef_b), 14));
+
+  /* Each pair term applies to two pixels; packus is the [0, 255] clamp */
+  __m128i R = _mm_packus_epi16(
+      _mm_add_epi16(ya, _mm_unpacklo_epi16(r, r)),
+      _mm_add_epi16(yb, _mm_unpackhi_epi16(r, r)));
+  __m128i G = _mm_packus_epi16(
+      _mm_add_epi16(ya, _mm_unpacklo_epi16(g, g)),
+      _mm_add_epi16(yb, _mm_unpackhi_epi16(g, g)));
+  __m128i B = _mm_packus_epi16(
+      _mm_add_epi16(ya, _mm_unpacklo_epi16(bl, bl)),
+      _mm_add_epi16(yb, _mm_unpackhi_epi16(bl, bl)));
+
+  store_rgb24_ssse3(bgr ? B : R, G, bgr ? R : B, shuf, out);
+}
+
+/** @internal
+ * @brief SSSE3 kernel, 16 pixels per iteration
+ */
+template <bool uyvy, bool bgr>
+UVC_TARGET("ssse3")
+static void yuv422_to_rgb24_ssse3(const uint8_t *in, uint8_t *out, size_t pixels) {
+  const __m128i lo_byte = _mm_set1_epi16(0x00ff);
+  __m128i shuf[9];
+
+  load_interleave_ssse3(shuf);
+
+  for (; pixels >= 16; pixels -= 16, in += 32, out += 48) {
+    __m128i a = _mm_loadu_si128((const __m128i *) in);
+    __m128i b = _mm_loadu_si128((const __m128i *) (in + 16));
+
+    /* Y as 16-bit lanes for pixels 0-7 and 8-15, chroma as U,V,U,V... */
+    if (uyvy)
+      yuv_to_rgb24_ssse3<bgr>(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8),
+          _mm_and_si128(a, lo_byte), _mm_and_si128(b, lo_byte), shuf, out);
+    else
+      yuv_to_rgb24_ssse3<bgr>(_mm_and_si128(a, lo_byte), _mm_and_si128(b, lo_byte),
+          _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8), shuf, out);
+  }
+
+  yuv422_to_rgb24_c<uyvy, bgr>(in, out, pixels);
+}
+
+/** @internal
+ * @brief SSSE3 NV12 kernel, 16 pixels per iteration
+ */
+template <bool bgr>
+UVC_TARGET("ssse3")
+static void nv12_to_rgb24_ssse3(const uint8_t *y, const uint8_t *uv, uint8_t *out, size_t pixels) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i shuf[9];
+
+  load_interleave_ssse3(shuf);
+
+  for (; pixels >= 16; pixels -= 16, y += 16, uv += 16, out += 48) {
+    __m128i yy = _mm_loadu_si128((const __m128i *) y);
+    __m128i cc = _mm_loadu_si128((const __m128i *) uv);
+
+    yuv_to_rgb24_ssse3<bgr>(_mm_unpacklo_epi8(yy, zero), _mm_unpackhi_epi8(yy, zero),
+        _mm_unpacklo_epi8(cc, zero), _mm_unpackhi_epi8(cc, zero), shuf, out);
+  }
+
+  nv12_to_rgb24_c<bgr>(y, uv, out, pixels);
+}
+
+UVC_TARGET("ssse3")
+static void gray_to_rgb24_ssse3(const uint8_t *in, uint8_t *out, size_t pixels) {
+  __m128i shuf[9], spread[3];
+
+  /* Each output byte is taken from exactly one channel's mask */
+  load_interleave_ssse3(shuf);
+  for (int j = 0; j < 3; ++j)
+    spread[j] = _mm_and_si128(_mm_and_si128(shuf[j], shuf[3 + j]), shuf[6 + j]);
+
+  for (; pixels >= 16; pixels -= 16, in += 16, out += 48) {
+    __m128i y = _mm_loadu_si128((const __m128i *) in);
+
+    for (int j = 0; j < 3; ++j)
+      _mm_storeu_si128((__m128i *) (out + 16 * j), _mm_shuffle_epi8(y, spread[j]));
+  }
+
+  gray_to_rgb24_c(in, out, pixels);
+}
+
+/** @internal
+ * @brief SSE2 16-to-8-bit gray kernel, 16 pixels per iteration
+ *
+ * Saturating arithmetic does the clamps: the subtraction stops at 0, and
+ * adding then subtracting 0xff00 caps the shifted value at 255.
+ */
+UVC_TARGET("ssse3")
+static void gray16_to_gray8_ssse3(const uint8_t *in, uint8_t *out, size_t pixels,
+    int shift, uint16_t offset) {
+  const __m128i off = _mm_set1_epi16((short) offset);
+  const __m128i cap = _mm_set1_epi16((short) 0xff00);
+  const __m128i count = _mm_cvtsi32_si128(shift);
+
+  for (; pixels >= 16; pixels -= 16, in += 32, out += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *) in);
+    __m128i b = _mm_loadu_si128((const __m128i *) (in + 16));
+
+    a = _mm_srl_epi16(_mm_subs_epu16(a, off), count);
+    b = _mm_srl_epi16(_mm_subs_epu16(b, off), count);
+    a = _mm_subs_epu16(_mm_adds_epu16(a, cap), cap);
+    b = _mm_subs_epu16(_mm_adds_epu16(b, cap), cap);
+    _mm_storeu_si128((__m128i *) out, _mm_packus_epi16(a, b));
+  }
+
+  gray16_to_gray8_c(in, out, pixels, shift, offset);
+}
+
+/** Gathers the Y bytes of 8 packed 4:2:2 pixels into the low half and
+ * their U,V pairs into the high half */
+static inline __m128i yuv422_split_mask(bool uyvy) {
+  return uyvy ? _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, 0, 2, 4, 6, 8, 10, 12, 14)
+              : _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+}
+
+/** @internal
+ * @brief SSSE3 4:2:2 to 4:2:0 kernel, 16 pixels of both rows per iteration
+ *
+ * pavgb rounds up exactly as the scalar (a + b + 1) >> 1 does.
+ */
+template <bool uyvy, bool nv12>
+UVC_TARGET("ssse3")
+static void yuv422_to_420_ssse3(const uint8_t *r0, const uint8_t *r1, uint8_t *y0, uint8_t *y1,
+    uint8_t *u, uint8_t *v, size_t pixels) {
+  const __m128i split = yuv422_split_mask(uyvy);
+  const __m128i uv_split = yuv422_split_mask(false);
+
+  for (; pixels >= 16; pixels -= 16, r0 += 32, r1 += 32, y0 += 16, y1 += 16) {
+    __m128i a0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) r0), split);
+    __m128i b0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (r0 + 16)), split);
+    __m128i a1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) r1), split);
+    __m128i b1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (r1 + 16)), split);
+    __m128i c = _mm_avg_epu8(_mm_unpackhi_epi64(a0, b0), _mm_unpackhi_epi64(a1, b1));
+
+    _mm_storeu_si128((__m128i *) y0, _mm_unpacklo_epi64(a0, b0));
+    _mm_storeu_si128((__m128i *) y1, _mm_unpacklo_epi64(a1, b1));
+    if (nv12) {
+      _mm_storeu_si128((__m128i *) u, c);
+      u += 16;
+    } else {
+      c = _mm_shuffle_epi8(c, uv_split);
+      _mm_storel_epi64((__m128i *) u, c);
+      _mm_storel_epi64((__m128i *) v, _mm_srli_si128(c, 8));
+      u += 8;
+      v += 8;
+    }
+  }
+
+  yuv422_to_420_c<uyvy, nv12>(r0, r1, y0, y1, u, v, pixels);
+}
+
+/** @internal
+ * @brief SSE2 4:2:2 luma extraction kernel, 16 pixels per iteration
+ *
+ * Each pixel is a 16-bit word with Y in the low (YUYV) or high (UYVY)
+ * byte; masking or shifting leaves Y as a word that packs down to a byte.
+ */
+template <bool uyvy>
+UVC_TARGET("ssse3")
+static void yuv422_to_y_ssse3(const uint8_t *in, uint8_t *out, size_t pixels) {
+  const __m128i mask = _mm_set1_epi16(0xff);
+
+  for (; pixels >= 16; pixels -= 16, in += 32, out += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *) in);
+    __m128i b = _mm_loadu_si128((const __m128i *) (in + 16));
+
+    a = uyvy ? _mm_srli_epi16(a, 8) : _mm_and_si128(a, mask);
+    b = uyvy ? _mm_srli_epi16(b, 8) : _mm_and_si128(b, mask);
+    _mm_storeu_si128((__m128i *) out, _mm_packus_epi16(a, b));
+  }
+
+  yuv422_to_y_c<uyvy>(in, out, pixels);
+}
+
+/** (a + b + c + d + 2) >> 2 for 16 bytes */
+UVC_TARGET("ssse3")
+static inline __m128i avg4_ssse3(__m128i a, __m128i b, __m128i c, __m128i d) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i two = _mm_set1_epi16(2);
+  __m128i lo = _mm_add_epi16(
+      _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+      _mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+  __m128i hi = _mm_add_epi16(
+      _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+      _mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+
+  return _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(lo, two), 2),
+                          _mm_srli_epi16(_mm_add_epi16(hi, two), 2));
+}
+
+/** Bytes of @p a where @p mask is set, of @p b elsewhere */
+UVC_TARGET("ssse3")
+static inline __m128i select_ssse3(__m128i mask, __m128i a, __m128i b) {
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/** @internal
+ * @brief SSSE3 bilinear demosaic, 16 pixels per iteration
+ *
+ * Both kinds of site are computed for every pixel and the right one picked
+ * per column. The vector loop starts at column 1, so every load stays
+ * inside the row; the edge columns go to the scalar code.
+ */
+template <bool bgr>
+UVC_TARGET("ssse3")
+static void bayer_to_rgb24_ssse3(const uint8_t *u, const uint8_t *c, const uint8_t *d,
+    uint8_t *out, size_t width, int pattern) {
+  int g_first = pattern & 1, red_row = (pattern >> 1) & 1;
+  /* Columns 1 + i with i even are own-colour sites if green comes first */
+  const __m128i own_site = _mm_set1_epi16(g_first ? 0x00ff : (short) 0xff00);
+  __m128i shuf[9];
+  size_t x = 1;
+
+  load_interleave_ssse3(shuf);
+  bayer_span_c<bgr>(u, c, d, out, width, 0, 1, g_first, red_row);
+
+  for (; x + 17 <= width; x += 16) {
+    __m128i cl = _mm_loadu_si128((const __m128i *) (c + x - 1));
+    __m128i cc = _mm_loadu_si128((const __m128i *) (c + x));
+    __m128i cr = _mm_loadu_si128((const __m128i *) (c + x + 1));
+    __m128i uu = _mm_loadu_si128((const __m128i *) (u + x));
+    __m128i dd = _mm_loadu_si128((const __m128i *) (d + x));
+    __m128i diag = avg4_ssse3(
+        _mm_loadu_si128((const __m128i *) (u + x - 1)),
+        _mm_loadu_si128((const __m128i *) (u + x + 1)),
+        _mm_loadu_si128((const __m128i *) (d + x - 1)),
+        _mm_loadu_si128((const __m128i *) (d + x + 1)));
+
+    __m128i own = select_ssse3(own_site, cc, _mm_avg_epu8(cl, cr));
+    __m128i green = select_ssse3(own_site, avg4_ssse3(cl, cr, uu, dd), cc);
+    __m128i other = select_ssse3(own_site, diag, _mm_avg_epu8(uu, dd));
+    __m128i R = red_row ? own : other;
+    __m128i B = red_row ? other : own;
+
+    store_rgb24_ssse3(bgr ? B : R, green, bgr ? R : B, shuf, out + 3 * x);
+  }
+
+  bayer_span_c<bgr>(u, c, d, out, width, x, width, g_first, red_row);
+}
+
+/** @internal
+ * @brief AVX2 kernel, 32 pixels per iteration
+ *
+ * Same arithmetic as the SSSE3 kernel. The 128-bit lanes keep the pack and
+ * unpack steps in lockstep with the Y lanes, so only the packed channel
+ * bytes need a cross-lane fix-up before the per-lane interleave.
+ */
+/** @internal
+ * @brief Convert 32 pixels of YUV to 24-bit RGB/BGR
+ *
+ * As yuv_to_rgb24_ssse3(), with the lanes of @p ya holding pixels 0-7 and
+ * 8-15 and those of @p yb pixels 16-23 and 24-31.
+ */
+template <bool bgr>
+UVC_TARGET("avx2")
+static inline void yuv_to_rgb24_avx2(__m256i ya, __m256i yb, __m256i ca, __m256i cb,
+    const __m256i shuf[9], uint8_t *out) {
+  const __m256i bias = _mm256_set1_epi16(128);
+  const __m256i coef_r = _mm256_set1_epi32(uv_coef(0, 22987));
+  const __m256i coef_g = _mm256_set1_epi32(uv_coef(-5636, -11698));
+  const __m256i coef_b = _mm256_set1_epi32(uv_coef(29049, 0));
+
+  ca = _mm256_sub_epi16(ca, bias);
+  cb = _mm256_sub_epi16(cb, bias);
+
+  __m256i r = _mm256_packs_epi32(
+      _mm256_srai_epi32(_mm256_madd_epi16(ca, coef_r), 14),
+      _mm256_srai_epi32(_mm256_madd_epi16(cb, coef_r), 14));
+  __m256i g = _mm256_packs_epi32(
+      _mm256_srai_epi32(_mm256_madd_epi16(ca, coef_g), 14),
+      _mm256_srai_epi32(_mm256_madd_epi16(cb, coef_g), 14));
+  __m256i bl = _mm256_packs_epi32(
+      _mm256_srai_epi32(_mm256_madd_epi16(ca, coef_b), 14),
+      _mm256_srai_epi32(_mm256_madd_epi16(cb, coef_b), 14));
+
+  /* Pixels land as 0-7, 16-23 | 8-15, 24-31; put the qwords in order */
+  __m256i R = _mm256_permute4x64_epi64(_mm256_packus_epi16(
+      _mm256_add_epi16(ya, _mm256_unpacklo_epi16(r, r)),
+      _mm256_add_epi16(yb, _mm256_unpackhi_epi16(r, r))), 0xd8);
+  __m256i G = _mm256_permute4x64_epi64(_mm256_packus_epi16(
+      _mm256_add_epi16(ya, _mm256_unpacklo_epi16(g, g)),
+      _mm256_add_epi16(yb, _mm256_unpackhi_epi16(g, g))), 0xd8);
+  __m256i B = _mm256_permute4x64_epi64(_mm256_packus_epi16(
+      _mm256_add_epi16(ya, _mm256_unpacklo_epi16(bl, bl)),
+      _mm256_add_epi16(yb, _mm256_unpackhi_epi16(bl, bl))), 0xd8);
+
+  __m256i c0 = bgr ? B : R;
+  __m256i c2 = bgr ? R : B;
+  __m256i o[3];
+
+  /* Lane 0 holds chunks of pixels 0-15, lane 1 those of 16-31 */
+  for (int j = 0; j < 3; ++j)
+    o[j] = _mm256_or_si256(
+        _mm256_or_si256(_mm256_shuffle_epi8(c0, shuf[j]), _mm256_shuffle_epi8(G, shuf[3 + j])),
+        _mm256_shuffle_epi8(c2, shuf[6 + j]));
+
+  _mm256_storeu_si256((__m256i *) out, _mm256_permute2x128_si256(o[0], o[1], 0x20));
+  _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o[2], o[0], 0x30));
+  _mm256_storeu_si256((__m256i *) (out + 64), _mm256_permute2x128_si256(o[1], o[2], 0x31));
+}
+
+UVC_TARGET("avx2")
+static inline void load_interleave_avx2(__m256i shuf[9]) {
+  for (int i = 0; i < 9; ++i)
+    shuf[i] = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *) rgb24_interleave[i]));
+}
+
+template <bool uyvy, bool bgr>
+UVC_TARGET("avx2")
+static void yuv422_to_rgb24_avx2(const uint8_t *in, uint8_t *out, size_t pixels) {
+  const __m256i lo_byte = _mm256_set1_epi16(0x00ff);
+  __m256i shuf[9];
+
+  load_interleave_avx2(shuf);
+
+  for (; pixels >= 32; pixels -= 32, in += 64, out += 96) {
+    __m256i a = _mm256_loadu_si256((const __m256i *) in);
+    __m256i b = _mm256_loadu_si256((const __m256i *) (in + 32));
+
+    if (uyvy)
+      yuv_to_rgb24_avx2<bgr>(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8),
+          _mm256_and_si256(a, lo_byte), _mm256_and_si256(b, lo_byte), shuf, out);
+    else
+      yuv_to_rgb24_avx2<bgr>(_mm256_and_si256(a, lo_byte), _mm256_and_si256(b, lo_byte),
+          _mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8), shuf, out);
+  }
+
+  yuv422_to_rgb24_ssse3<uyvy, bgr>(in, out, pixels);
+}
+
+/** @internal
+ * @brief AVX2 NV12 kernel, 32 pixels per iteration
+ *
+ * Widening each 128-bit half puts pixels 0-7 | 8-15 and 16-23 | 24-31 in
+ * the lanes, the same layout the 4:2:2 kernel gets from its loads.
+ */
+template <bool bgr>
+UVC_TARGET("avx2")
+static void nv12_to_rgb24_avx2(const uint8_t *y, const uint8_t *uv, uint8_t *out, size_t pixels) {
+  __m256i shuf[9];
+
+  load_interleave_avx2(shuf);
+
+  for (; pixels >= 32; pixels -= 32, y += 32, uv += 32, out += 96) {
+    __m128i y0 = _mm_loadu_si128((const __m128i *) y);
+    __m128i y1 = _mm_loadu_si128((const __m128i *) (y + 16));
+    __m128i c0 = _mm_loadu_si128((const __m128i *) uv);
+    __m128i c1 = _mm_loadu_si128((const __m128i *) (uv + 16));
+
+    yuv_to_rgb24_avx2<bgr>(_mm256_cvtepu8_epi16(y0), _mm256_cvtepu8_epi16(y1),
+        _mm256_cvtepu8_epi16(c0), _mm256_cvtepu8_epi16(c1), shuf, out);
+  }
+
+  nv12_to_rgb24_ssse3<bgr>(y, uv, out, pixels);
+}
+
+UVC_TARGET("avx2")
+static void gray16_to_gray8_avx2(const uint8_t *in, uint8_t *out, size_t pixels,
+    int shift, uint16_t offset) {
+  const __m256i off = _mm256_set1_epi16((short) offset);
+  const __m256i cap = _mm256_set1_epi16((short) 0xff00);
+  const __m128i count = _mm_cvtsi32_si128(shift);
+
+  for (; pixels >= 32; pixels -= 32, in += 64, out += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i *) in);
+    __m256i b = _mm256_loadu_si256((const __m256i *) (in + 32));
+
+    a = _mm256_srl_epi16(_mm256_subs_epu16(a, off), count);
+    b = _mm256_srl_epi16(_mm256_subs_epu16(b, off), count);
+    a = _mm256_subs_epu16(_mm256_adds_epu16(a, cap), cap);
+    b = _mm256_subs_epu16(_mm256_adds_epu16(b, cap), cap);
+    _mm256_storeu_si256((__m256i *) out,
+        _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+  }
+
+  gray16_to_gray8_ssse3(in, out, pixels, shift, offset);
+}
+
+/** @internal
+ * @brief AVX2 4:2:2 to 4:2:0 kernel, 32 pixels of both rows per iteration
+ *
+ * The in-lane split leaves 8-pixel groups in the order 0, 2, 1, 3, which
+ * one cross-lane permute puts right.
+ */
+template <bool uyvy, bool nv12>
+UVC_TARGET("avx2")
+static void yuv422_to_420_avx2(const uint8_t *r0, const uint8_t *r1, uint8_t *y0, uint8_t *y1,
+    uint8_t *u, uint8_t *v, size_t pixels) {
+  const __m256i split = _mm256_broadcastsi128_si256(yuv422_split_mask(uyvy));
+  const __m256i uv_split = _mm256_broadcastsi128_si256(yuv422_split_mask(false));
+
+  for (; pixels >= 32; pixels -= 32, r0 += 64, r1 += 64, y0 += 32, y1 += 32) {
+    __m256i a0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) r0), split);
+    __m256i b0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (r0 + 32)), split);
+    __m256i a1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) r1), split);
+    __m256i b1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (r1 + 32)), split);
+    __m256i c = _mm256_permute4x64_epi64(_mm256_avg_epu8(
+        _mm256_unpackhi_epi64(a0, b0), _mm256_unpackhi_epi64(a1, b1)), 0xd8);
+
+    _mm256_storeu_si256((__m256i *) y0,
+        _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a0, b0), 0xd8));
+    _mm256_storeu_si256((__m256i *) y1,
+        _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a1, b1), 0xd8));
+    if (nv12) {
+      _mm256_storeu_si256((__m256i *) u, c);
+      u += 32;
+    } else {
+      c = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(c, uv_split), 0xd8);
+      _mm_storeu_si128((__m128i *) u, _mm256_castsi256_si128(c));
+      _mm_storeu_si128((__m128i *) v, _mm256_extracti128_si256(c, 1));
+      u += 16;
+      v += 16;
+    }
+  }
+
+  yuv422_to_420_ssse3<uyvy, nv12>(r0, r1, y0, y1, u, v, pixels);
+}
+
+template <bool uyvy>
+UVC_TARGET("avx2")
+static void yuv422_to_y_avx2(const uint8_t *in, uint8_t *out, size_t pixels) {
+  const __m256i mask = _mm256_set1_epi16(0xff);
+
+  for (; pixels >= 32; pixels -= 32, in += 64, out += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i *) in);
+    __m256i b = _mm256_loadu_si256((const __m256i *) (in + 32));
+
+    a = uyvy ? _mm256_srli_epi16(a, 8) : _mm256_and_si256(a, mask);
+    b = uyvy ? _mm256_srli_epi16(b, 8) : _mm256_and_si256(b, mask);
+    _mm256_storeu_si256((__m256i *) out,
+        _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+  }
+
+  yuv422_to_y_ssse3<uyvy>(in, out, pixels);
+}
+
+static enum uvc_simd_level detect_simd_level(void) {
+#ifdef _MSC_VER
+  int regs[4];
+
+  __cpuid(regs, 0);
+  if (regs[0] < 7)
+    return UVC_SIMD_NONE;
+
+  __cpuid(regs, 1);
+  int ssse3 = (regs[2] >> 9) & 1;
+  int osxsave = (regs[2] >> 27) & 1;
+  int avx = (regs[2] >> 28) & 1;
+
+  __cpuidex(regs, 7, 0);
+  int avx2 = (regs[1] >> 5) & 1;
+
+  /* The OS must save the YMM state for AVX2 to be usable */
+  if (avx2 && avx && osxsave && (_xgetbv(0) & 0x6) == 0x6)
+    return UVC_SIMD_AVX2;
+  return ssse3 ? UVC_SIMD_SSSE3 : UVC_SIMD_NONE;
+#else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return UVC_SIMD_AVX2;
+  if (__builtin_cpu_supports("ssse3"))
+    return UVC_SIMD_SSSE3;
+  return UVC_SIMD_NONE;
+#endif
+}
+
+#endif /* UVC_SIMD_X86 */
+
+#ifdef UVC_SIMD_ARM
+
+/** @internal
+ * @brief Per-pair r, g and b terms for 8 chroma pairs
+ */
+static inline void neon_chroma(uint8x8_t u8, uint8x8_t v8,
+    int16x8_t *r, int16x8_t *g, int16x8_t *b) {
+  const uint8x8_t bias = vdup_n_u8(128);
+  int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(u8, bias));
+  int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(v8, bias));
+
+  int32x4_t r_lo = vmull_n_s16(vget_low_s16(v), 22987);
+  int32x4_t r_hi = vmull_n_s16(vget_high_s16(v), 22987);
+  int32x4_t g_lo = vmlal_n_s16(vmull_n_s16(vget_low_s16(u), -5636), vget_low_s16(v), -11698);
+  int32x4_t g_hi = vmlal_n_s16(vmull_n_s16(vget_high_s16(u), -5636), vget_high_s16(v), -11698);
+  int32x4_t b_lo = vmull_n_s16(vget_low_s16(u), 29049);
+  int32x4_t b_hi = vmull_n_s16(vget_high_s16(u), 29049);
+
+  /* The shifted values fit in 16 bits, so the narrowing shift is exact */
+  *r = vcombine_s16(vshrn_n_s32(r_lo, 14), vshrn_n_s32(r_hi, 14));
+  *g = vcombine_s16(vshrn_n_s32(g_lo, 14), vshrn_n_s32(g_hi, 14));
+  *b = vcombine_s16(vshrn_n_s32(b_lo, 14), vshrn_n_s32(b_hi, 14));
+}
+
+/** Y + term, clamped, for 16 pixels sharing the terms of 16 pairs */
+static inline uint8x16_t neon_add_sat(uint8x16_t y, int16x8_t t_lo, int16x8_t t_hi) {
+  int16x8_t y_lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y)));
+  int16x8_t y_hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y)));
+  return vcombine_u8(vqmovun_s16(vaddq_s16(y_lo, t_lo)), vqmovun_s16(vaddq_s16(y_hi, t_hi)));
+}
+
+/** @internal
+ * @brief Convert 32 pixels of YUV to 24-bit RGB/BGR
+ *
+ * @p y0 and @p y1 hold the Y of the even and odd pixels, @p u and @p v
+ * the chroma pair each even/odd pixel pair shares.
+ */
+template <bool bgr>
+static inline void yuv_to_rgb24_neon(uint8x16_t y0, uint8x16_t y1,
+    uint8x16_t u, uint8x16_t v, uint8_t *out) {
+  int16x8_t r[2], g[2], b[2];
+
+  neon_chroma(vget_low_u8(u), vget_low_u8(v), &r[0], &g[0], &b[0]);
+  neon_chroma(vget_high_u8(u), vget_high_u8(v), &r[1], &g[1], &b[1]);
+
+  /* Even and odd pixels separately, then zip back into pixel order */
+  uint8x16x2_t R = vzipq_u8(neon_add_sat(y0, r[0], r[1]), neon_add_sat(y1, r[0], r[1]));
+  uint8x16x2_t G = vzipq_u8(neon_add_sat(y0, g[0], g[1]), neon_add_sat(y1, g[0], g[1]));
+  uint8x16x2_t B = vzipq_u8(neon_add_sat(y0, b[0], b[1]), neon_add_sat(y1, b[0], b[1]));
+
+  for (int j = 0; j < 2; ++j) {
+    uint8x16x3_t o;
+    o.val[0] = bgr ? B.val[j] : R.val[j];
+    o.val[1] = G.val[j];
+    o.val[2] = bgr ? R.val[j] : B.val[j];
+    vst3q_u8(out + 48 * j, o);
+  }
+}
+
+/** @internal
+ * @brief NEON kernel, 32 pixels per iteration
+ */
+template <bool uyvy, bool bgr>
+static void yuv422_to_rgb24_neon(const uint8_t *in, uint8_t *out, size_t pixels) {
+  for (; pixels >= 32; pixels -= 32, in += 64, out += 96) {
+    uint8x16x4_t p = vld4q_u8(in);
+
+    yuv_to_rgb24_neon<bgr>(p.val[uyvy ? 1 : 0], p.val[uyvy ? 3 : 2],
+                           p.val[uyvy ? 0 : 1], p.val[uyvy ? 2 : 3], out);
+  }
+
+  yuv422_to_rgb24_c<uyvy, bgr>(in, out, pixels);
+}
+
+/** @internal
+ * @brief NEON NV12 kernel, 32 pixels per iteration
+ */
+template <bool bgr>
+static void nv12_to_rgb24_neon(const uint8_t *y, const uint8_t *uv, uint8_t *out, size_t pixels) {
+  for (; pixels >= 32; pixels -= 32, y += 32, uv += 32, out += 96) {
+    uint8x16x2_t yy = vld2q_u8(y);
+    uint8x16x2_t cc = vld2q_u8(uv);
+
+    yuv_to_rgb24_neon<bgr>(yy.val[0], yy.val[1], cc.val[0], cc.val[1], out);
+  }
+
+  nv12_to_rgb24_c<bgr>(y, uv, out, pixels);
+}
+
+static void gray_to_rgb24_neon(const uint8_t *in, uint8_t *out, size_t pixels) {
+  for (; pixels >= 16; pixels -= 16, in += 16, out += 48) {
+    uint8x16x3_t o;
+
+    o.val[0] = o.val[1] = o.val[2] = vld1q_u8(in);
+    vst3q_u8(out, o);
+  }
+
+  gray_to_rgb24_c(in, out, pixels);
+}
+
+static void gray16_to_gray8_neon(const uint8_t *in, uint8_t *out, size_t pixels,
+    int shift, uint16_t offset) {
+  const uint16x8_t off = vdupq_n_u16(offset);
+  const int16x8_t right = vdupq_n_s16((int16_t) -shift);
+
+  for (; pixels >= 16; pixels -= 16, in += 32, out += 16) {
+    uint16x8_t a = vreinterpretq_u16_u8(vld1q_u8(in));
+    uint16x8_t b = vreinterpretq_u16_u8(vld1q_u8(in + 16));
+
+    a = vshlq_u16(vqsubq_u16(a, off), right);
+    b = vshlq_u16(vqsubq_u16(b, off), right);
+    vst1q_u8(out, vcombine_u8(vqmovn_u16(a), vqmovn_u16(b)));
+  }
+
+  gray16_to_gray8_c(in, out, pixels, shift, offset);
+}
+
+/** @internal
+ * @brief NEON 4:2:2 to 4:2:0 kernel, 32 pixels of both rows per iteration
+ */
+template <bool uyvy, bool nv12>
+static void yuv422_to_420_neon(const uint8_t *r0, const uint8_t *r1, uint8_t *y0, uint8_t *y1,
+    uint8_t *u, uint8_t *v, size_t pixels) {
+  const int yo = uyvy ? 1 : 0, uo = uyvy ? 0 : 1;
+
+  for (; pixels >= 32; pixels -= 32, r0 += 64, r1 += 64, y0 += 32, y1 += 32) {
+    uint8x16x4_t p0 = vld4q_u8(r0);
+    uint8x16x4_t p1 = vld4q_u8(r1);
+    uint8x16x2_t yy, cc;
+
+    yy.val[0] = p0.val[yo];
+    yy.val[1] = p0.val[yo + 2];
+    vst2q_u8(y0, yy);
+    yy.val[0] = p1.val[yo];
+    yy.val[1] = p1.val[yo + 2];
+    vst2q_u8(y1, yy);
+
+    cc.val[0] = vrhaddq_u8(p0.val[uo], p1.val[uo]);
+    cc.val[1] = vrhaddq_u8(p0.val[uo + 2], p1.val[uo + 2]);
+    if (nv12) {
+      vst2q_u8(u, cc);
+      u += 32;
+    } else {
+      vst1q_u8(u, cc.val[0]);
+      vst1q_u8(v, cc.val[1]);
+      u += 16;
+      v += 16;
+    }
+  }
+
+  yuv422_to_420_c<uyvy, nv12>(r0, r1, y0, y1, u, v, pixels);
+}
+
+template <bool uyvy>
+static void yuv422_to_y_neon(const uint8_t *in, uint8_t *out, size_t pixels) {
+  for (; pixels >= 16; pixels -= 16, in += 32, out += 16)
+    vst1q_u8(out, vld2q_u8(in).val[uyvy ? 1 : 0]);
+
+  yuv422_to_y_c<uyvy>(in, out, pixels);
+}
+
+/** (a + b + c + d + 2) >> 2 for 16 bytes */
+static inline uint8x16_t neon_avg4(uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t d) {
+  uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a), vget_low_u8(b)),
+                            vaddl_u8(vget_low_u8(c), vget_low_u8(d)));
+  uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a), vget_high_u8(b)),
+                            vaddl_u8(vget_high_u8(c), vget_high_u8(d)));
+
+  return vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2));
+}
+
+/** @internal
+ * @brief NEON bilinear demosaic, 16 pixels per iteration; see bayer_to_rgb24_ssse3()
+ */
+template <bool bgr>
+static void bayer_to_rgb24_neon(const uint8_t *u, const uint8_t *c, const uint8_t *d,
+    uint8_t *out, size_t width, int pattern) {
+  static const uint8_t even_lanes[16] = {
+    0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0
+  };
+  int g_first = pattern & 1, red_row = (pattern >> 1) & 1;
+  uint8x16_t own_site = vld1q_u8(even_lanes);
+  size_t x = 1;
+
+  if (!g_first)
+    own_site = vmvnq_u8(own_site);
+
+  bayer_span_c<bgr>(u, c, d, out, width, 0, 1, g_first, red_row);
+
+  for (; x + 17 <= width; x += 16) {
+    uint8x16_t cl = vld1q_u8(c + x - 1);
+    uint8x16_t cc = vld1q_u8(c + x);
+    uint8x16_t cr = vld1q_u8(c + x + 1);
+    uint8x16_t uu = vld1q_u8(u + x);
+    uint8x16_t dd = vld1q_u8(d + x);
+    uint8x16_t diag = neon_avg4(vld1q_u8(u + x - 1), vld1q_u8(u + x + 1),
+                                vld1q_u8(d + x - 1), vld1q_u8(d + x + 1));
+    uint8x16x3_t o;
+
+    uint8x16_t own = vbslq_u8(own_site, cc, vrhaddq_u8(cl, cr));
+    uint8x16_t green = vbslq_u8(own_site, neon_avg4(cl, cr, uu, dd), cc);
+    uint8x16_t other = vbslq_u8(own_site, diag, vrhaddq_u8(uu, dd));
+    uint8x16_t R = red_row ? own : other;
+    uint8x16_t B = red_row ? other : own;
+
+    o.val[0] = bgr ? B : R;
+    o.val[1] = green;
+    o.val[2] = bgr ? R : B;
+    vst3q_u8(out + 3 * x, o);
+  }
+
+  bayer_span_c<bgr>(u, c, d, out, width, x, width, g_first, red_row);
+}
+
+#endif /* UVC_SIMD_ARM */
+
+/** @internal
+ * @brief Best instruction set level of the running CPU, detected once
+ */
+enum uvc_simd_level _uvc_simd_level(void) {
+#if defined(UVC_SIMD_X86)
+  static const enum uvc_simd_level level = detect_simd_level();
+  return level;
+#elif defined(UVC_SIMD_ARM)
+  return UVC_SIMD_NEON;
+#else
+  return UVC_SIMD_NONE;
+#endif
+}
+
+/** @internal
+ * @brief Get a packed 4:2:2 to 24-bit RGB/BGR converter
+ *
+ * The converter takes an even pixel count and has no alignment
+ * requirements. Levels the build or the CPU lacks fall back to the
+ * next lower one.
+ *
+ * @param uyvy Input is UYVY rather than YUYV
+ * @param bgr Output is BGR rather than RGB
+ * @param level Highest instruction set to use, usually _uvc_simd_level()
+ */
+uvc_yuv422_rgb_fn _uvc_get_yuv422_rgb(int uyvy, int bgr, enum uvc_simd_level level) {
+  static const uvc_yuv422_rgb_fn scalar[2][2] = {
+    { yuv422_to_rgb24_c<false, false>, yuv422_to_rgb24_c<false, true> },
+    { yuv422_to_rgb24_c<true, false>, yuv422_to_rgb24_c<true, true> },
+  };
+
+  uyvy = !!uyvy;
+  bgr = !!bgr;
+  if (level > _uvc_simd_level())
+    level = _uvc_simd_level();
+
+#ifdef UVC_SIMD_X86
+  static const uvc_yuv422_rgb_fn ssse3[2][2] = {
+    { yuv422_to_rgb24_ssse3<false, false>, yuv422_to_rgb24_ssse3<false, true> },
+    { yuv422_to_rgb24_ssse3<true, false>, yuv422_to_rgb24_ssse3<true, true> },
+  };
+  static const uvc_yuv422_rgb_fn avx2[2][2] = {
+    { yuv422_to_rgb24_avx2<false, false>, yuv422_to_rgb24_avx2<false, true> },
+    { yuv422_to_rgb24_avx2<true, false>, yuv422_to_rgb24_avx2<true, true> },
+  };
+
+  if (level >= UVC_SIMD_AVX2)
+    return avx2[uyvy][bgr];
+  if (level >= UVC_SIMD_SSSE3)
+    return ssse3[uyvy][bgr];
+#endif
+#ifdef UVC_SIMD_ARM
+  static const uvc_yuv422_rgb_fn neon[2][2] = {
+    { yuv422_to_rgb24_neon<false, false>, yuv422_to_rgb24_neon<false, true> },
+    { yuv422_to_rgb24_neon<true, false>, yuv422_to_rgb24_neon<true, true> },
+  };
+
+  if (level >= UVC_SIMD_NEON)
+    return neon[uyvy][bgr];
+#endif
+
+  return scalar[uyvy][bgr];
+}
+
+/** @internal
+ * @brief Get an NV12 row to 24-bit RGB/BGR converter
+ *
+ * As _uvc_get_yuv422_rgb(); the converter takes an even pixel count.
+ */
+uvc_nv12_rgb_fn _uvc_get_nv12_rgb(int bgr, enum uvc_simd_level level) {
+  bgr = !!bgr;
+  if (level > _uvc_simd_level())
+    level = _uvc_simd_level();
+
+#ifdef UVC_SIMD_X86
+  if (level >= UVC_SIMD_AVX2)
+    return bgr ? nv12_to_rgb24_avx2<true> : nv12_to_rgb24_avx2<false>;
+  if (level >= UVC_SIMD_SSSE3)
+    return bgr ? nv12_to_rgb24_ssse3<true> : nv12_to_rgb24_ssse3<false>;
+#endif
+#ifdef UVC_SIMD_ARM
+  if (level >= UVC_SIMD_NEON)
+    return bgr ? nv12_to_rgb24_neon<true> : nv12_to_rgb24_neon<false>;
+#endif
+
+  return bgr ? nv12_to_rgb24_c<true> : nv12_to_rgb24_c<false>;
+}
+
+/** @internal
+ * @brief Get an 8-bit gray to 24-bit RGB converter (also BGR, being gray)
+ */
+uvc_gray_rgb_fn _uvc_get_gray_rgb(enum uvc_simd_level level) {
+  if (level > _uvc_simd_level())
+    level = _uvc_simd_level();
+
+#ifdef UVC_SIMD_X86
+  if (level >= UVC_SIMD_SSSE3)
+    return gray_to_rgb24_ssse3;
+#endif
+#ifdef UVC_SIMD_ARM
+  if (level >= UVC_SIMD_NEON)
+    return gray_to_rgb24_neon;
+#endif
+
+  return gray_to_rgb24_c;
+}
+
+/** @internal
+ * @brief Get a 16-bit to 8-bit gray converter
+ */
+uvc_gray16_fn _uvc_get_gray16(enum uvc_simd_level level) {
+  if (level > _uvc_simd_level())
+    level = _uvc_simd_level();
+
+#ifdef UVC_SIMD_X86
+  if (level >= UVC_SIMD_AVX2)
+    return gray16_to_gray8_avx2;
+  if (level >= UVC_SIMD_SSSE3)
+    return gray16_to_gray8_ssse3;
+#endif
+#ifdef UVC_SIMD_ARM
+  if (level >= UVC_SIMD_NEON)
+    return gray16_to_gray8_neon;
+#endif
+
+  return gray16_to_gray8_c;
+}
+
+/** @internal
+ * @brief Get a packed 4:2:2 to I420 or NV12 converter
+ *
+ * As _uvc_get_yuv422_rgb(); the converter takes an even pixel count.
+ *
+ * @param uyvy Input is UYVY rather than YUYV
+ * @param nv12 Chroma is written as NV12 U,V pairs rather than I420 planes
+ */
+uvc_yuv422_420_fn _uvc_get_yuv422_420(int uyvy, int nv12, enum uvc_simd_level level) {
+  static const uvc_yuv422_420_fn scalar[2][2] = {
+    { yuv422_to_420_c<false, false>, yuv422_to_420_c<false, true> },
+    { yuv422_to_420_c<true, false>, yuv422_to_420_c<true, true> },
+  };
+
+  uyvy = !!uyvy;
+  nv12 = !!nv12;
+  if (level > _uvc_simd_level())
+    level = _uvc_simd_level();
+
+#ifdef UVC_SIMD_X86
+  static const uvc_yuv422_420_fn ssse3[2][2] = {
+    { yuv422_to_420_ssse3<false, false>, yuv422_to_420_ssse3<false, true> },
+    { yuv422_to_420_ssse3<true, false>, yuv422_to_420_ssse3<true, true> },
+  };
+  static const uvc_yuv422_420_fn avx2[2][2] = {
+    { yuv422_to_420_avx2<false, false>, yuv422_to_420_avx2<false, true> },
+    { yuv422_to_420_avx2<true, false>, yuv422_to_420_avx2<true, true> },
+  };
+
+  if (level >= UVC_SIMD_AVX2)
+    return avx2[uyvy][nv12];
+  if (level >= UVC_SIMD_SSSE3)
+    return ssse3[uyvy][nv12];
+#endif
+#ifdef UVC_SIMD_ARM
+  static const uvc_yuv422_420_fn neon[2][2] = {
+    { yuv422_to_420_neon<false, false>, yuv422_to_420_neon<false, true> },
+    { yuv422_to_420_neon<true, false>, yuv422_to_420_neon<true, true> },
+  };
+
+  if (level >= UVC_SIMD_NEON)
+    return neon[uyvy][nv12];
+#endif
+
+  return scalar[uyvy][nv12];
+}
+
+/** @internal
+ * @brief Get a packed 4:2:2 luma extractor, producing 8-bit gray
+ *
+ * As _uvc_get_yuv422_rgb(), except that any pixel count is accepted.
+ *
+ * @param uyvy Input is UYVY rather than YUYV
+ */
+uvc_yuv422_y_fn _uvc_get_yuv422_y(int uyvy, enum uvc_simd_level level) {
+  if (level > _uvc_simd_level())
+    level = _uvc_simd_level();
+
+#ifdef UVC_SIMD_X86
+  if (level >= UVC_SIMD_AVX2)
+    return uyvy ? yuv422_to_y_avx2<true> : yuv422_to_y_avx2<false>;
+  if (level >= UVC_SIMD_SSSE3)
+    return uyvy ? yuv422_to_y_ssse3<true> : yuv422_to_y_ssse3<false>;
+#endif
+#ifdef UVC_SIMD_ARM
+  if (level >= UVC_SIMD_NEON)
+    return uyvy ? yuv422_to_y_neon<true> : yuv422_to_y_neon<false>;
+#endif
+
+  return uyvy ? yuv422_to_y_c<true> : yuv422_to_y_c<false>;
+}
+
+/** @internal
+ * @brief Get a Bayer row demosaicer producing 24-bit RGB/BGR
+ *
+ * There is no AVX2 kernel; AVX2 levels get the SSSE3 one.
+ */
+uvc_bayer_rgb_fn _uvc_get_bayer_rgb(int bgr, enum uvc_simd_level level) {
+  bgr = !!bgr;
+  if (level > _uvc_simd_level())
+    level = _uvc_simd_level();
+
+#ifdef UVC_SIMD_X86
+  if (level >= UVC_SIMD_SSSE3)
+    return bgr ? bayer_to_rgb24_ssse3<true> : bayer_to_rgb24_ssse3<false>;
+#endif
+#ifdef UVC_SIMD_ARM
+  if (level >= UVC_SIMD_NEON)
+    return bgr ? bayer_to_rgb24_neon<true> : bayer_to_rgb24_neon<false>;
+#endif
+
+  return bgr ? bayer_to_rgb24_c<true> : bayer_to_rgb24_c<false>;
+}
@@ -0,0 +1,202 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (C) 2010-2012 Ken Tossell
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the author nor other contributors may be
+*     used to endorse or promote products derived from this software
+*     without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+/**
+ * @internal
+ * @file frame-threads.cpp
+ * @brief Thread pool that converts frames in row stripes
+ */
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+#include <system_error>
+
+/** @internal
+ * @brief Run stripes of the posted job until none are left unclaimed
+ *
+ * Called and returns with pool->mutex held.
+ */
+static void conv_pool_work(struct uvc_conv_pool *pool, std::unique_lock<std::mutex> &lock) {
+  while (pool->fn && pool->next_stripe < pool->num_stripes) {
+    void (*fn)(void *, int, int) = pool->fn;
+    void *arg = pool->arg;
+    int num_stripes = pool->num_stripes;
+    int stripe = pool->next_stripe++;
+
+    lock.unlock();
+    fn(arg, stripe, num_stripes);
+    lock.lock();
+
+    if (--pool->pending == 0)
+      pool->done_cond.notify_all();
+  }
+}
+
+static void conv_pool_worker(struct uvc_conv_pool *pool) {
+  std::unique_lock<std::mutex> lock(pool->mutex);
+
+  while (!pool->stop) {
+    conv_pool_work(pool, lock);
+    if (!pool->stop)
+      pool->work_cond.wait(lock);
+  }
+}
+
+/** @internal
+ * @brief Stop and free a conversion pool; NULL is ignored
+ */
+void _uvc_conv_pool_free(struct uvc_conv_pool *pool) {
+  if (!pool)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->stop = 1;
+  }
+  pool->work_cond.notify_all();
+
+  for (auto &thread : pool->threads)
+    thread.join();
+
+  delete pool;
+}
+
+/** @brief Convert frames on several threads
+ * @ingroup frame
+ *
+ * The RGB/BGR converters split frames whose source device belongs to
+ * this context into row stripes and convert them on num_threads threads,
+ * the calling one included. MJPEG frames are split at restart markers;
+ * frames without a restart interval, with vertically subsampled chroma
+ * or in a progressive encoding are decoded in one piece. The output is
+ * identical to a single-threaded conversion.
+ *
+ * The pool converts one frame at a time. A conversion that starts while
+ * the pool is busy with another frame runs on its calling thread alone.
+ *
+ * Call this while no conversions of this context's frames are running.
+ *
+ * @param ctx UVC context
+ * @param num_threads Threads per frame; 0 or 1 disables striping (the default)
+ */
+uvc_error_t uvc_set_conversion_threads(uvc_context_t *ctx, int num_threads) {
+  struct uvc_conv_pool *pool;
+
+  if (num_threads < 0)
+    return UVC_ERROR_INVALID_PARAM;
+
+  _uvc_conv_pool_free(ctx->conv_pool);
+  ctx->conv_pool = NULL;
+
+  if (num_threads <= 1)
+    return UVC_SUCCESS;
+
+  pool = new uvc_conv_pool();
+  try {
+    for (int i = 1; i < num_threads; ++i)
+      pool->threads.emplace_back(conv_pool_worker, pool);
+  } catch (const std::system_error &) {
+    _uvc_conv_pool_free(pool);
+    return UVC_ERROR_NO_MEM;
+  }
+
+  ctx->conv_pool = pool;
+  return UVC_SUCCESS;
+}
+
+/** @internal
+ * @brief Conversion pool of the context a frame was captured in, if any
+ */
+struct uvc_conv_pool *_uvc_frame_conv_pool(uvc_frame_t *frame) {
+  uvc_device_handle_t *devh = frame->source;
+
+  if (!devh || !devh->dev || !devh->dev->ctx)
+    return NULL;
+
+  return devh->dev->ctx->conv_pool;
+}
+
+/** @internal
+ * @brief Number of stripes to cut @p rows rows into
+ *
+ * @param pool Conversion pool, or NULL for no striping
+ * @param rows Rows (or other units) available to split
+ * @param min_rows Smallest stripe worth the hand-off to another thread
+ */
+int _uvc_conv_stripes(struct uvc_conv_pool *pool, int rows, int min_rows) {
+  int num_stripes;
+
+  if (!pool)
+    return 1;
+
+  num_stripes = (int) pool->threads.size() + 1;
+  if (min_rows < 1)
+    min_rows = 1;
+  if (num_stripes > rows / min_rows)
+    num_stripes = rows / min_rows;
+
+  return num_stripes > 1 ? num_stripes : 1;
+}
+
+/** @internal
+ * @brief Call fn(arg, stripe, num_stripes) for every stripe and wait
+ *
+ * Runs the stripes on the calling thread when there is no pool, only one
+ * stripe, or the pool is busy with another job.
+ */
+void _uvc_conv_run(struct uvc_conv_pool *pool, int num_stripes,
+    void (*fn)(void *arg, int stripe, int num_stripes), void *arg) {
+  std::unique_lock<std::mutex> busy;
+
+  if (pool && num_stripes > 1)
+    busy = std::unique_lock<std::mutex>(pool->run_mutex, std::try_to_lock);
+
+  if (!busy.owns_lock()) {
+    for (int stripe = 0; stripe < num_stripes; ++stripe)
+      fn(arg, stripe, num_stripes);
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(pool->mutex);
+
+  pool->fn = fn;
+  pool->arg = arg;
+  pool->num_stripes = num_stripes;
+  pool->next_stripe = 0;
+  pool->pending = num_stripes;
+  pool->work_cond.notify_all();
+
+  conv_pool_work(pool, lock);
+  pool->done_cond.wait(lock, [pool] { return pool->pending == 0; });
+  pool->fn = NULL;
+}
@@ -38,12 +38,74 @@
 #include "libuvc/libuvc.h"
 #include "libuvc/libuvc_internal.h"
 
+#include <climits>
+
+/** @internal
+ * @brief Allocate frame data aligned to UVC_FRAME_DATA_ALIGN bytes
+ *
+ * Free with _uvc_frame_data_free().
+ */
+void *_uvc_frame_data_alloc(size_t bytes) {
+#ifdef _MSC_VER
+  return _aligned_malloc(bytes ? bytes : 1, UVC_FRAME_DATA_ALIGN);
+#else
+  void *data;
+
+  if (posix_memalign(&data, UVC_FRAME_DATA_ALIGN, bytes ? bytes : 1))
+    return NULL;
+  return data;
+#endif
+}
+
 /** @internal */
+void _uvc_frame_data_free(void *data) {
+#ifdef _MSC_VER
+  _aligned_free(data);
+#else
+  free(data);
+#endif
+}
+
+/** @internal
+ * @brief Row pitch for converter output rows of row_bytes bytes
+ *
+ * A caller-supplied buffer (library_owns_data == 0) that has a step keeps
+ * it; library buffers are packed.
+ *
+ * @return The pitch, or 0 if the caller's step is shorter than a row
+ */
+size_t _uvc_out_step(const uvc_frame_t *out, size_t row_bytes) {
+  if (!out->library_owns_data && out->step)
+    return out->step >= row_bytes ? out->step : 0;
+  return row_bytes;
+}
+
+/** @internal
+ * @brief Row pitch of converter input rows of row_bytes bytes
+ *
+ * A step of zero means packed rows.
+ *
+ * @param rows Rows the frame's data must hold, or 0 not to check
+ * @return The pitch, or 0 if the step is shorter than a row or the data
+ *   shorter than the rows
+ */
+size_t _uvc_in_step(const uvc_frame_t *in, size_t row_bytes, size_t rows) {
+  size_t step = in->step ? in->step : row_bytes;
+
+  if (step < row_bytes || (rows && in->data_bytes < step * (rows - 1) + row_bytes))
+    return 0;
+  return step;
+}
+
+/** @internal
+ * Library-owned data is reallocated, not resized: its contents do not survive.
+ */
 uvc_error_t uvc_ensure_frame_size(uvc_frame_t *frame, size_t need_bytes) {
   if (frame->library_owns_data) {
     if (!frame->data || frame->data_bytes != need_bytes) {
-      frame->data_bytes = need_bytes;
-      frame->data = realloc(frame->data, frame->data_bytes);
+      _uvc_frame_data_free(frame->data);
+      frame->data = _uvc_frame_data_alloc(need_bytes);
+      frame->data_bytes = frame->data ? need_bytes : 0;
     }
     if (!frame->data)
       return UVC_ERROR_NO_MEM;
@@ -55,9 +117,31 @@ uvc_error_t uvc_ensure_frame_size(uvc_frame_t *frame, size_t need_bytes) {
   }
 }
 
+/** @internal
+ * @brief Chroma plane pitch of an I420 or NV12 image with Y plane pitch `step`
+ *
+ * NV12 rounds up to whole U,V pairs; I420 halves, rounding up.
+ */
+size_t _uvc_chroma_step(enum uvc_frame_format format, size_t step) {
+  return format == UVC_FRAME_FORMAT_NV12 ? (step + 1) & ~(size_t) 1 : (step + 1) / 2;
+}
+
+/** @internal
+ * @brief Make room for `rows` output rows `step` bytes apart
+ *
+ * The last row needs only its own bytes, so a caller's buffer may end
+ * right after the image, as a sub-rectangle of a larger image does.
+ */
+uvc_error_t _uvc_ensure_frame_rows(uvc_frame_t *out, size_t step, size_t row_bytes, size_t rows) {
+  return uvc_ensure_frame_size(out, rows ? step * (rows - 1) + row_bytes : 0);
+}
+
 /** @brief Allocate a frame structure
  * @ingroup frame
  *
+ * The data buffer, here and as resized by the conversion functions, starts
+ * on a UVC_FRAME_DATA_ALIGN byte boundary.
+ *
  * @param data_bytes Number of bytes to allocate, or zero
  * @return New frame, or NULL on error
  */
@@ -73,7 +157,7 @@ uvc_frame_t *uvc_allocate_frame(size_t data_bytes) {
 
   if (data_bytes > 0) {
     frame->data_bytes = data_bytes;
-    frame->data = malloc(data_bytes);
+    frame->data = _uvc_frame_data_alloc(data_bytes);
 
     if (!frame->data) {
       delete frame;
@@ -93,9 +177,10 @@ void uvc_free_frame(uvc_frame_t *frame) {
   if (frame->library_owns_data)
   {
     if (frame->data_bytes > 0)
-      free(frame->data);
+      _uvc_frame_data_free(frame->data);
     if (frame->metadata_bytes > 0)
       free(frame->metadata);
+    free(frame->nal_units);
   }
 
   delete frame;
@@ -105,27 +190,72 @@ static inline unsigned char sat(int i) {
   return (unsigned char)( i >= 255 ? 255 : (i < 0 ? 0 : i));
 }
 
+/** @internal
+ * @brief Bytes per pixel of a single-plane uncompressed format, 0 for others
+ */
+static size_t packed_bpp(enum uvc_frame_format format) {
+  switch (format) {
+  case UVC_FRAME_FORMAT_RGB:
+  case UVC_FRAME_FORMAT_BGR:
+    return 3;
+  case UVC_FRAME_FORMAT_YUYV:
+  case UVC_FRAME_FORMAT_UYVY:
+  case UVC_FRAME_FORMAT_GRAY16:
+    return 2;
+  case UVC_FRAME_FORMAT_GRAY8:
+  case UVC_FRAME_FORMAT_BY8:
+  case UVC_FRAME_FORMAT_BA81:
+  case UVC_FRAME_FORMAT_SGRBG8:
+  case UVC_FRAME_FORMAT_SGBRG8:
+  case UVC_FRAME_FORMAT_SRGGB8:
+  case UVC_FRAME_FORMAT_SBGGR8:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
 /** @brief Duplicate a frame, preserving color format
  * @ingroup frame
  *
+ * Single-plane uncompressed images are copied line by line into a
+ * caller-supplied buffer whose step differs from the original's; all
+ * else is copied byte for byte.
+ *
  * @param in Original frame
  * @param out Duplicate frame
  */
 uvc_error_t uvc_duplicate_frame(uvc_frame_t *in, uvc_frame_t *out) {
-  if (uvc_ensure_frame_size(out, in->data_bytes) < 0)
-    return UVC_ERROR_NO_MEM;
+  size_t row_bytes = (size_t) in->width * packed_bpp(in->frame_format);
+  size_t in_step = row_bytes ? _uvc_in_step(in, row_bytes, in->height) : 0;
+  size_t out_step = in->step;
+
+  if (in_step && !out->library_owns_data && out->step && out->step != in_step) {
+    out_step = _uvc_out_step(out, row_bytes);
+    if (!out_step)
+      return UVC_ERROR_INVALID_PARAM;
+    if (_uvc_ensure_frame_rows(out, out_step, row_bytes, in->height) < 0)
+      return UVC_ERROR_NO_MEM;
+
+    for (uint32_t row = 0; row < in->height; ++row)
+      memcpy((uint8_t *) out->data + row * out_step,
+             (const uint8_t *) in->data + row * in_step, row_bytes);
+  } else {
+    if (uvc_ensure_frame_size(out, in->data_bytes) < 0)
+      return UVC_ERROR_NO_MEM;
+
+    memcpy(out->data, in->data, in->data_bytes);
+  }
 
   out->width = in->width;
   out->height = in->height;
   out->frame_format = in->frame_format;
-  out->step = in->step;
+  out->step = out_step;
   out->sequence = in->sequence;
   out->capture_time = in->capture_time;
   out->capture_time_finished = in->capture_time_finished;
   out->source = in->source;
 
-  memcpy(out->data, in->data, in->data_bytes);
-
   if (in->metadata && in->metadata_bytes > 0)
   {
       if (out->metadata_bytes < in->metadata_bytes)
@@ -136,6 +266,15 @@ uvc_error_t uvc_duplicate_frame(uvc_frame_t *in, uvc_frame_t *out) {
       memcpy(out->metadata, in->metadata, in->metadata_bytes);
   }
 
+  if (in->num_nal_units > 0) {
+    if (out->num_nal_units < in->num_nal_units)
+      out->nal_units = (uvc_nal_unit_t *) realloc(out->nal_units,
+          in->num_nal_units * sizeof(uvc_nal_unit_t));
+    memcpy(out->nal_units, in->nal_units, in->num_nal_units * sizeof(uvc_nal_unit_t));
+  }
+  out->num_nal_units = in->num_nal_units;
+  out->key_frame = in->key_frame;
+
   return UVC_SUCCESS;
 }
 
@@ -150,71 +289,87 @@ uvc_error_t uvc_duplicate_frame(uvc_frame_t *in, uvc_frame_t *out) {
     (prgb)[4] = sat(pyuv[2] + g); \
     (prgb)[5] = sat(pyuv[2] + b); \
     }
-#define IYUYV2RGB_2(pyuv, prgb) { \
-    int r = (22987 * ((pyuv)[3] - 128)) >> 14; \
-    int g = (-5636 * ((pyuv)[1] - 128) - 11698 * ((pyuv)[3] - 128)) >> 14; \
-    int b = (29049 * ((pyuv)[1] - 128)) >> 14; \
-    (prgb)[0] = sat(*(pyuv) + r); \
-    (prgb)[1] = sat(*(pyuv) + g); \
-    (prgb)[2] = sat(*(pyuv) + b); \
-    (prgb)[3] = sat((pyuv)[2] + r); \
-    (prgb)[4] = sat((pyuv)[2] + g); \
-    (prgb)[5] = sat((pyuv)[2] + b); \
-    }
-#define IYUYV2RGB_16(pyuv, prgb) IYUYV2RGB_8(pyuv, prgb); IYUYV2RGB_8(pyuv + 16, prgb + 24);
-#define IYUYV2RGB_8(pyuv, prgb) IYUYV2RGB_4(pyuv, prgb); IYUYV2RGB_4(pyuv + 8, prgb + 12);
-#define IYUYV2RGB_4(pyuv, prgb) IYUYV2RGB_2(pyuv, prgb); IYUYV2RGB_2(pyuv + 4, prgb + 6);
+struct yuv422_rgb_job {
+  uvc_yuv422_rgb_fn convert;
+  const uint8_t *in;
+  size_t in_step;
+  uint8_t *out;
+  size_t out_step;
+  size_t width;
+  size_t height;
+};
+
+static void yuv422_rgb_stripe(void *arg, int stripe, int num_stripes) {
+  struct yuv422_rgb_job *job = (struct yuv422_rgb_job *) arg;
+  size_t row = job->height * stripe / num_stripes;
+  size_t end = job->height * (stripe + 1) / num_stripes;
+  const uint8_t *in = job->in + row * job->in_step;
+  uint8_t *out = job->out + row * job->out_step;
+
+  /* Packed rows convert as one run */
+  if (job->in_step == job->width * 2 && job->out_step == job->width * 3) {
+    job->convert(in, out, (end - row) * job->width);
+    return;
+  }
 
-/** @brief Convert a frame from YUYV to RGB
- * @ingroup frame
+  for (; row < end; ++row, in += job->in_step, out += job->out_step)
+    job->convert(in, out, job->width);
+}
+
+/** @internal
+ * @brief Convert packed 4:2:2 to packed 24-bit RGB/BGR in row stripes
  *
- * @param in YUYV frame
- * @param out RGB frame
+ * The width must be even, as each 4-byte macropixel holds two pixels.
  */
-uvc_error_t uvc_yuyv2rgb(uvc_frame_t *in, uvc_frame_t *out) {
-  if (in->frame_format != UVC_FRAME_FORMAT_YUYV)
+static uvc_error_t convert_yuv422_rgb(uvc_frame_t *in, uvc_frame_t *out, int uyvy, int bgr) {
+  struct uvc_conv_pool *pool;
+  struct yuv422_rgb_job job;
+  size_t in_step = _uvc_in_step(in, in->width * 2, in->height);
+  size_t out_step = _uvc_out_step(out, in->width * 3);
+  /* A stripe of under ~64k pixels costs more to hand off than to convert */
+  int min_rows = 65536 / (in->width ? in->width : 1);
+
+  if ((in->width & 1) || !in_step || !out_step)
     return UVC_ERROR_INVALID_PARAM;
 
-  if (uvc_ensure_frame_size(out, in->width * in->height * 3) < 0)
+  if (_uvc_ensure_frame_rows(out, out_step, in->width * 3, in->height) < 0)
     return UVC_ERROR_NO_MEM;
 
   out->width = in->width;
   out->height = in->height;
-  out->frame_format = UVC_FRAME_FORMAT_RGB;
-  out->step = in->width * 3;
+  out->frame_format = bgr ? UVC_FRAME_FORMAT_BGR : UVC_FRAME_FORMAT_RGB;
+  out->step = out_step;
   out->sequence = in->sequence;
   out->capture_time = in->capture_time;
   out->capture_time_finished = in->capture_time_finished;
   out->source = in->source;
 
-  uint8_t *pyuv = (uint8_t *)in->data;
-  uint8_t *prgb = (uint8_t *)out->data;
-  uint8_t *prgb_end = prgb + out->data_bytes;
+  job.convert = _uvc_get_yuv422_rgb(uyvy, bgr, _uvc_simd_level());
+  job.in = (const uint8_t *) in->data;
+  job.in_step = in_step;
+  job.out = (uint8_t *) out->data;
+  job.out_step = out_step;
+  job.width = in->width;
+  job.height = in->height;
 
-  while (prgb < prgb_end) {
-    IYUYV2RGB_8(pyuv, prgb);
-
-    prgb += 3 * 8;
-    pyuv += 2 * 8;
-  }
+  pool = _uvc_frame_conv_pool(in);
+  _uvc_conv_run(pool, _uvc_conv_stripes(pool, in->height, min_rows), yuv422_rgb_stripe, &job);
 
   return UVC_SUCCESS;
 }
 
-#define IYUYV2BGR_2(pyuv, pbgr) { \
-    int r = (22987 * ((pyuv)[3] - 128)) >> 14; \
-    int g = (-5636 * ((pyuv)[1] - 128) - 11698 * ((pyuv)[3] - 128)) >> 14; \
-    int b = (29049 * ((pyuv)[1] - 128)) >> 14; \
-    (pbgr)[0] = sat(*(pyuv) + b); \
-    (pbgr)[1] = sat(*(pyuv) + g); \
-    (pbgr)[2] = sat(*(pyuv) + r); \
-    (pbgr)[3] = sat((pyuv)[2] + b); \
-    (pbgr)[4] = sat((pyuv)[2] + g); \
-    (pbgr)[5] = sat((pyuv)[2] + r); \
-    }
-#define IYUYV2BGR_16(pyuv, pbgr) IYUYV2BGR_8(pyuv, pbgr); IYUYV2BGR_8(pyuv + 16, pbgr + 24);
-#define IYUYV2BGR_8(pyuv, pbgr) IYUYV2BGR_4(pyuv, pbgr); IYUYV2BGR_4(pyuv + 8, pbgr + 12);
-#define IYUYV2BGR_4(pyuv, pbgr) IYUYV2BGR_2(pyuv, pbgr); IYUYV2BGR_2(pyuv + 4, pbgr + 6);
+/** @brief Convert a frame from YUYV to RGB
+ * @ingroup frame
+ *
+ * @param in YUYV frame
+ * @param out RGB frame
+ */
+uvc_error_t uvc_yuyv2rgb(uvc_frame_t *in, uvc_frame_t *out) {
+  if (in->frame_format != UVC_FRAME_FORMAT_YUYV)
+    return UVC_ERROR_INVALID_PARAM;
+
+  return convert_yuv422_rgb(in, out, 0, 0);
+}
 
 /** @brief Convert a frame from YUYV to BGR
  * @ingroup frame
@@ -226,36 +381,75 @@ uvc_error_t uvc_yuyv2bgr(uvc_frame_t *in, uvc_frame_t *out) {
   if (in->frame_format != UVC_FRAME_FORMAT_YUYV)
     return UVC_ERROR_INVALID_PARAM;
 
-  if (uvc_ensure_frame_size(out, in->width * in->height * 3) < 0)
+  return convert_yuv422_rgb(in, out, 0, 1);
+}
+
+struct yuv422_y_job {
+  uvc_yuv422_y_fn convert;
+  const uint8_t *in;
+  size_t in_step;
+  uint8_t *out;
+  size_t out_step;
+  size_t width;
+  size_t height;
+};
+
+static void yuv422_y_stripe(void *arg, int stripe, int num_stripes) {
+  struct yuv422_y_job *job = (struct yuv422_y_job *) arg;
+  size_t row = job->height * stripe / num_stripes;
+  size_t end = job->height * (stripe + 1) / num_stripes;
+  const uint8_t *in = job->in + row * job->in_step;
+  uint8_t *out = job->out + row * job->out_step;
+
+  /* Packed rows convert as one run */
+  if (job->in_step == job->width * 2 && job->out_step == job->width) {
+    job->convert(in, out, (end - row) * job->width);
+    return;
+  }
+
+  for (; row < end; ++row, in += job->in_step, out += job->out_step)
+    job->convert(in, out, job->width);
+}
+
+/** @internal
+ * @brief Copy the luma of packed 4:2:2 to GRAY8 in row stripes
+ */
+static uvc_error_t convert_yuv422_y(uvc_frame_t *in, uvc_frame_t *out, int uyvy) {
+  struct uvc_conv_pool *pool;
+  struct yuv422_y_job job;
+  size_t in_step = _uvc_in_step(in, in->width * 2, in->height);
+  size_t out_step = _uvc_out_step(out, in->width);
+  int min_rows = 65536 / (in->width ? in->width : 1);
+
+  if (!in_step || !out_step)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (_uvc_ensure_frame_rows(out, out_step, in->width, in->height) < 0)
     return UVC_ERROR_NO_MEM;
 
   out->width = in->width;
   out->height = in->height;
-  out->frame_format = UVC_FRAME_FORMAT_BGR;
-  out->step = in->width * 3;
+  out->frame_format = UVC_FRAME_FORMAT_GRAY8;
+  out->step = out_step;
   out->sequence = in->sequence;
   out->capture_time = in->capture_time;
   out->capture_time_finished = in->capture_time_finished;
   out->source = in->source;
 
-  uint8_t *pyuv = (uint8_t *)in->data;
-  uint8_t *pbgr = (uint8_t *)out->data;
-  uint8_t *pbgr_end = pbgr + out->data_bytes;
+  job.convert = _uvc_get_yuv422_y(uyvy, _uvc_simd_level());
+  job.in = (const uint8_t *) in->data;
+  job.in_step = in_step;
+  job.out = (uint8_t *) out->data;
+  job.out_step = out_step;
+  job.width = in->width;
+  job.height = in->height;
 
-  while (pbgr < pbgr_end) {
-    IYUYV2BGR_8(pyuv, pbgr);
-
-    pbgr += 3 * 8;
-    pyuv += 2 * 8;
-  }
+  pool = _uvc_frame_conv_pool(in);
+  _uvc_conv_run(pool, _uvc_conv_stripes(pool, in->height, min_rows), yuv422_y_stripe, &job);
 
   return UVC_SUCCESS;
 }
 
-#define IYUYV2Y(pyuv, py) { \
-    (py)[0] = (pyuv[0]); \
-    }
-
 /** @brief Convert a frame from YUYV to Y (GRAY8)
  * @ingroup frame
  *
@@ -266,86 +460,193 @@ uvc_error_t uvc_yuyv2y(uvc_frame_t *in, uvc_frame_t *out) {
   if (in->frame_format != UVC_FRAME_FORMAT_YUYV)
     return UVC_ERROR_INVALID_PARAM;
 
-  if (uvc_ensure_frame_size(out, in->width * in->height) < 0)
+  return convert_yuv422_y(in, out, 0);
+}
+
+#define IYUYV2UV(pyuv, puv) { \
+    (puv)[0] = (pyuv[1]); \
+    }
+
+/** @brief Convert a frame from YUYV to UV (GRAY8)
+ * @ingroup frame
+ *
+ * @param in YUYV frame
+ * @param out GRAY8 frame
+ */
+uvc_error_t uvc_yuyv2uv(uvc_frame_t *in, uvc_frame_t *out) {
+  if (in->frame_format != UVC_FRAME_FORMAT_YUYV)
+    return UVC_ERROR_INVALID_PARAM;
+
+  size_t in_step = _uvc_in_step(in, in->width * 2, in->height);
+  size_t out_step = _uvc_out_step(out, in->width);
+
+  if (!in_step || !out_step)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (_uvc_ensure_frame_rows(out, out_step, in->width, in->height) < 0)
     return UVC_ERROR_NO_MEM;
 
   out->width = in->width;
   out->height = in->height;
   out->frame_format = UVC_FRAME_FORMAT_GRAY8;
-  out->step = in->width;
+  out->step = out_step;
   out->sequence = in->sequence;
   out->capture_time = in->capture_time;
   out->capture_time_finished = in->capture_time_finished;
   out->source = in->source;
 
-  uint8_t *pyuv = (uint8_t *)in->data;
-  uint8_t *py = (uint8_t *)out->data;
-  uint8_t *py_end = py + out->data_bytes;
+  for (uint32_t row = 0; row < in->height; ++row) {
+    uint8_t *pyuv = (uint8_t *)in->data + row * in_step;
+    uint8_t *puv = (uint8_t *)out->data + row * out_step;
+    uint8_t *puv_end = puv + in->width;
 
-  while (py < py_end) {
-    IYUYV2Y(pyuv, py);
+    while (puv < puv_end) {
+      IYUYV2UV(pyuv, puv);
 
-    py += 1;
-    pyuv += 2;
+      puv += 1;
+      pyuv += 2;
+    }
   }
 
   return UVC_SUCCESS;
 }
 
-#define IYUYV2UV(pyuv, puv) { \
-    (puv)[0] = (pyuv[1]); \
-    }
+struct yuv422_420_job {
+  uvc_yuv422_420_fn convert;
+  const uint8_t *in;
+  size_t in_step;
+  uint8_t *y;
+  size_t y_step;
+  uint8_t *u;
+  uint8_t *v;
+  size_t uv_step;
+  size_t width;
+  size_t height;
+};
+
+/* Stripes are runs of row pairs, each read once for both its Y rows and
+ * its chroma row */
+static void yuv422_420_stripe(void *arg, int stripe, int num_stripes) {
+  struct yuv422_420_job *job = (struct yuv422_420_job *) arg;
+  size_t pairs = (job->height + 1) / 2;
+  size_t pair = pairs * stripe / num_stripes;
+  size_t end = pairs * (stripe + 1) / num_stripes;
+
+  for (; pair < end; ++pair) {
+    const uint8_t *r0 = job->in + 2 * pair * job->in_step;
+    uint8_t *y0 = job->y + 2 * pair * job->y_step;
+    /* An odd last row pairs with itself */
+    int last = 2 * pair + 1 == job->height;
+
+    job->convert(r0, last ? r0 : r0 + job->in_step, y0, last ? y0 : y0 + job->y_step,
+                 job->u + pair * job->uv_step, job->v ? job->v + pair * job->uv_step : NULL,
+                 job->width);
+  }
+}
 
-/** @brief Convert a frame from YUYV to UV (GRAY8)
- * @ingroup frame
- *
- * @param in YUYV frame
- * @param out GRAY8 frame
+/** @internal
+ * @brief Convert packed 4:2:2 to I420 or NV12 in stripes of row pairs
  */
-uvc_error_t uvc_yuyv2uv(uvc_frame_t *in, uvc_frame_t *out) {
-  if (in->frame_format != UVC_FRAME_FORMAT_YUYV)
+static uvc_error_t convert_yuv422_420(uvc_frame_t *in, uvc_frame_t *out, int uyvy,
+    enum uvc_frame_format format) {
+  struct uvc_conv_pool *pool;
+  struct yuv422_420_job job;
+  size_t in_step = _uvc_in_step(in, (size_t) in->width * 2, in->height);
+  size_t step = _uvc_out_step(out, in->width);
+  size_t uv_step = _uvc_chroma_step(format, step);
+  size_t uv_rows = (in->height + 1) / 2;
+  size_t y_bytes = step * in->height;
+  int nv12 = format == UVC_FRAME_FORMAT_NV12;
+  int min_pairs = 32768 / (in->width ? in->width : 1);
+
+  if ((in->width & 1) || !in_step || !step)
     return UVC_ERROR_INVALID_PARAM;
 
-  if (uvc_ensure_frame_size(out, in->width * in->height) < 0)
+  if (uvc_ensure_frame_size(out, y_bytes + (nv12 ? 1 : 2) * uv_step * uv_rows) < 0)
     return UVC_ERROR_NO_MEM;
 
   out->width = in->width;
   out->height = in->height;
-  out->frame_format = UVC_FRAME_FORMAT_GRAY8;
-  out->step = in->width;
+  out->frame_format = format;
+  out->step = step;
   out->sequence = in->sequence;
   out->capture_time = in->capture_time;
   out->capture_time_finished = in->capture_time_finished;
   out->source = in->source;
 
-  uint8_t *pyuv = (uint8_t *)in->data;
-  uint8_t *puv = (uint8_t *)out->data;
-  uint8_t *puv_end = puv + out->data_bytes;
+  job.convert = _uvc_get_yuv422_420(uyvy, nv12, _uvc_simd_level());
+  job.in = (const uint8_t *) in->data;
+  job.in_step = in_step;
+  job.y = (uint8_t *) out->data;
+  job.y_step = step;
+  job.u = job.y + y_bytes;
+  job.v = nv12 ? NULL : job.u + uv_step * uv_rows;
+  job.uv_step = uv_step;
+  job.width = in->width;
+  job.height = in->height;
 
-  while (puv < puv_end) {
-    IYUYV2UV(pyuv, puv);
-
-    puv += 1;
-    pyuv += 2;
-  }
+  pool = _uvc_frame_conv_pool(in);
+  _uvc_conv_run(pool, _uvc_conv_stripes(pool, (int) uv_rows, min_pairs), yuv422_420_stripe, &job);
 
   return UVC_SUCCESS;
 }
 
-#define IUYVY2RGB_2(pyuv, prgb) { \
-    int r = (22987 * ((pyuv)[2] - 128)) >> 14; \
-    int g = (-5636 * ((pyuv)[0] - 128) - 11698 * ((pyuv)[2] - 128)) >> 14; \
-    int b = (29049 * ((pyuv)[0] - 128)) >> 14; \
-    (prgb)[0] = sat((pyuv)[1] + r); \
-    (prgb)[1] = sat((pyuv)[1] + g); \
-    (prgb)[2] = sat((pyuv)[1] + b); \
-    (prgb)[3] = sat((pyuv)[3] + r); \
-    (prgb)[4] = sat((pyuv)[3] + g); \
-    (prgb)[5] = sat((pyuv)[3] + b); \
-    }
-#define IUYVY2RGB_16(pyuv, prgb) IUYVY2RGB_8(pyuv, prgb); IUYVY2RGB_8(pyuv + 16, prgb + 24);
-#define IUYVY2RGB_8(pyuv, prgb) IUYVY2RGB_4(pyuv, prgb); IUYVY2RGB_4(pyuv + 8, prgb + 12);
-#define IUYVY2RGB_4(pyuv, prgb) IUYVY2RGB_2(pyuv, prgb); IUYVY2RGB_2(pyuv + 4, prgb + 6);
+/** @brief Convert a frame from YUYV to I420
+ * @ingroup frame
+ *
+ * Each pair of rows is read once: their Y goes to the Y plane and their
+ * chroma, averaged vertically, to one row of the U and V planes.
+ *
+ * @param in YUYV frame of even width
+ * @param out I420 frame
+ */
+uvc_error_t uvc_yuyv2i420(uvc_frame_t *in, uvc_frame_t *out) {
+  if (in->frame_format != UVC_FRAME_FORMAT_YUYV)
+    return UVC_ERROR_INVALID_PARAM;
+
+  return convert_yuv422_420(in, out, 0, UVC_FRAME_FORMAT_I420);
+}
+
+/** @brief Convert a frame from YUYV to NV12
+ * @ingroup frame
+ *
+ * As uvc_yuyv2i420(), with the chroma written as interleaved U,V pairs.
+ *
+ * @param in YUYV frame of even width
+ * @param out NV12 frame
+ */
+uvc_error_t uvc_yuyv2nv12(uvc_frame_t *in, uvc_frame_t *out) {
+  if (in->frame_format != UVC_FRAME_FORMAT_YUYV)
+    return UVC_ERROR_INVALID_PARAM;
+
+  return convert_yuv422_420(in, out, 0, UVC_FRAME_FORMAT_NV12);
+}
+
+/** @brief Convert a frame from UYVY to I420
+ * @ingroup frame
+ *
+ * @param in UYVY frame of even width
+ * @param out I420 frame
+ */
+uvc_error_t uvc_uyvy2i420(uvc_frame_t *in, uvc_frame_t *out) {
+  if (in->frame_format != UVC_FRAME_FORMAT_UYVY)
+    return UVC_ERROR_INVALID_PARAM;
+
+  return convert_yuv422_420(in, out, 1, UVC_FRAME_FORMAT_I420);
+}
+
+/** @brief Convert a frame from UYVY to NV12
+ * @ingroup frame
+ *
+ * @param in UYVY frame of even width
+ * @param out NV12 frame
+ */
+uvc_error_t uvc_uyvy2nv12(uvc_frame_t *in, uvc_frame_t *out) {
+  if (in->frame_format != UVC_FRAME_FORMAT_UYVY)
+    return UVC_ERROR_INVALID_PARAM;
+
+  return convert_yuv422_420(in, out, 1, UVC_FRAME_FORMAT_NV12);
+}
 
 /** @brief Convert a frame from UYVY to RGB
  * @ingroup frame
@@ -356,78 +657,674 @@ uvc_error_t uvc_uyvy2rgb(uvc_frame_t *in, uvc_frame_t *out) {
   if (in->frame_format != UVC_FRAME_FORMAT_UYVY)
     return UVC_ERROR_INVALID_PARAM;
 
-  if (uvc_ensure_frame_size(out, in->width * in->height * 3) < 0)
+  return convert_yuv422_rgb(in, out, 1, 0);
+}
+
+/** @brief Convert a frame from UYVY to BGR
+ * @ingroup frame
+ * @param ini UYVY frame
+ * @param out BGR frame
+ */
+uvc_error_t uvc_uyvy2bgr(uvc_frame_t *in, uvc_frame_t *out) {
+  if (in->frame_format != UVC_FRAME_FORMAT_UYVY)
+    return UVC_ERROR_INVALID_PARAM;
+
+  return convert_yuv422_rgb(in, out, 1, 1);
+}
+
+/** @internal
+ * @brief Source position of one output sample: byte offsets of the two
+ * neighbouring samples and the weight of the second, out of 256
+ */
+struct resize_tap {
+  uint32_t a;
+  uint32_t b;
+  uint32_t frac;
+};
+
+struct yuv422_resize_job {
+  uvc_yuv422_rgb_fn convert;
+  const uint8_t *in;
+  size_t in_step;
+  uint8_t *out;
+  size_t out_step;
+  size_t in_width;
+  size_t in_height;
+  size_t out_width;
+  size_t out_height;
+  enum uvc_resize_filter filter;
+  /** Offset of Y and of U within a source pixel pair */
+  int y_off;
+  int u_off;
+  /** out_width taps for Y, then (out_width + 1) / 2 for U,V */
+  struct resize_tap *taps;
+  /** One resampled 4:2:2 row per stripe */
+  uint8_t *rows;
+};
+
+/** @internal
+ * @brief Source samples x0, x1 and the weight of x1, out of 256, for output
+ * sample i of n taken from n_in, aligning sample centres
+ */
+static void resize_position(size_t i, size_t n, size_t n_in, enum uvc_resize_filter filter,
+                            size_t *x0, size_t *x1, uint32_t *frac) {
+  /* Centre of output sample i in 16.16 input coordinates */
+  int64_t pos = (int64_t) ((((uint64_t) (2 * i + 1) * n_in) << 16) / (2 * n)) - 0x8000;
+
+  *frac = 0;
+  if (filter == UVC_RESIZE_NEAREST) {
+    *x0 = *x1 = (2 * i + 1) * n_in / (2 * n);
+  } else if (pos <= 0) {
+    *x0 = *x1 = 0;
+  } else {
+    *x0 = (size_t) (pos >> 16);
+    *x1 = *x0 + 1;
+    *frac = (uint32_t) (pos >> 8) & 0xff;
+  }
+  if (*x0 >= n_in)
+    *x0 = n_in - 1;
+  if (*x1 >= n_in)
+    *x1 = n_in - 1;
+}
+
+/** @internal
+ * @brief Taps for n output samples taken from n_in input samples spaced
+ * `stride` bytes apart, starting `offset` bytes in
+ */
+static void resize_taps(struct resize_tap *taps, size_t n, size_t n_in, size_t stride,
+                        size_t offset, enum uvc_resize_filter filter) {
+  for (size_t i = 0; i < n; ++i) {
+    size_t x0, x1;
+
+    resize_position(i, n, n_in, filter, &x0, &x1, &taps[i].frac);
+    taps[i].a = (uint32_t) (x0 * stride + offset);
+    taps[i].b = (uint32_t) (x1 * stride + offset);
+  }
+}
+
+/** @internal
+ * @brief Resample `n` samples from two source rows into `out`, spaced
+ * `stride` bytes apart
+ */
+static inline void resample(const struct resize_tap *taps, size_t n,
+                            const uint8_t *r0, const uint8_t *r1, uint32_t fy,
+                            uint8_t *out, size_t stride, enum uvc_resize_filter filter) {
+  if (filter == UVC_RESIZE_NEAREST) {
+    for (size_t i = 0; i < n; ++i, out += stride)
+      *out = r0[taps[i].a];
+  } else if (fy == 0) {
+    for (size_t i = 0; i < n; ++i, out += stride) {
+      const struct resize_tap *t = &taps[i];
+      uint32_t h0 = r0[t->a] * (256 - t->frac) + r0[t->b] * t->frac;
+
+      *out = (uint8_t) ((h0 + 128) >> 8);
+    }
+  } else {
+    for (size_t i = 0; i < n; ++i, out += stride) {
+      const struct resize_tap *t = &taps[i];
+      uint32_t h0 = r0[t->a] * (256 - t->frac) + r0[t->b] * t->frac;
+      uint32_t h1 = r1[t->a] * (256 - t->frac) + r1[t->b] * t->frac;
+
+      *out = (uint8_t) ((h0 * (256 - fy) + h1 * fy + 32768) >> 16);
+    }
+  }
+}
+
+static void yuv422_resize_stripe(void *arg, int stripe, int num_stripes) {
+  struct yuv422_resize_job *job = (struct yuv422_resize_job *) arg;
+  size_t row = job->out_height * stripe / num_stripes;
+  size_t end = job->out_height * (stripe + 1) / num_stripes;
+  size_t w = job->out_width;
+  size_t pairs = (w + 1) / 2;
+  size_t in_step = job->in_step;
+  const struct resize_tap *ctaps = job->taps + w;
+  uint8_t *yuv = job->rows + stripe * pairs * 4;
+
+  for (; row < end; ++row) {
+    const uint8_t *r0, *r1;
+    uint8_t *out = job->out + row * job->out_step;
+    size_t y0, y1;
+    uint32_t fy;
+
+    resize_position(row, job->out_height, job->in_height, job->filter, &y0, &y1, &fy);
+    r0 = job->in + y0 * in_step;
+    r1 = job->in + y1 * in_step;
+
+    /* Resample into a packed row of the source layout, chroma at half the
+     * output width, then convert it with the full-frame kernel */
+    resample(job->taps, w, r0, r1, fy, yuv + job->y_off, 2, job->filter);
+    resample(ctaps, pairs, r0, r1, fy, yuv + job->u_off, 4, job->filter);
+    resample(ctaps, pairs, r0 + 2, r1 + 2, fy, yuv + job->u_off + 2, 4, job->filter);
+
+    job->convert(yuv, out, w & ~(size_t) 1);
+    if (w & 1) {
+      /* The odd last pixel: convert its pair and keep the first half */
+      uint8_t last[6];
+
+      yuv[(w - 1) * 2 + 2 + job->y_off] = yuv[(w - 1) * 2 + job->y_off];
+      job->convert(yuv + (w - 1) * 2, last, 2);
+      memcpy(out + (w - 1) * 3, last, 3);
+    }
+  }
+}
+
+/** @brief Convert a YUYV or UYVY frame to RGB or BGR at another size
+ * @ingroup frame
+ *
+ * Resampling happens in the source's 4:2:2 space one output row at a time,
+ * so no full-size RGB image is ever written. Chroma is resampled at half
+ * the output width, as in the source.
+ *
+ * @param in YUYV or UYVY frame, at least 2 pixels wide
+ * @param out RGB or BGR frame of the requested size
+ * @param format UVC_FRAME_FORMAT_RGB or UVC_FRAME_FORMAT_BGR
+ * @param width Output width
+ * @param height Output height
+ * @param filter Resampling filter
+ */
+uvc_error_t uvc_yuv422_convert_resized(uvc_frame_t *in, uvc_frame_t *out,
+    enum uvc_frame_format format, int width, int height, enum uvc_resize_filter filter) {
+  struct uvc_conv_pool *pool;
+  struct yuv422_resize_job job;
+  int uyvy = in->frame_format == UVC_FRAME_FORMAT_UYVY;
+  size_t pairs = ((size_t) width + 1) / 2;
+  size_t in_step = _uvc_in_step(in, in->width * 2, in->height);
+  size_t out_step = _uvc_out_step(out, (size_t) width * 3);
+  int num_stripes;
+  int min_rows = 65536 / (width > 0 ? width : 1);
+
+  if ((in->frame_format != UVC_FRAME_FORMAT_YUYV && !uyvy) ||
+      (format != UVC_FRAME_FORMAT_RGB && format != UVC_FRAME_FORMAT_BGR) ||
+      (filter != UVC_RESIZE_NEAREST && filter != UVC_RESIZE_BILINEAR) ||
+      width <= 0 || height <= 0 || in->width < 2 || in->height < 1 ||
+      !in_step || !out_step)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (_uvc_ensure_frame_rows(out, out_step, (size_t) width * 3, height) < 0)
+    return UVC_ERROR_NO_MEM;
+
+  pool = _uvc_frame_conv_pool(in);
+  num_stripes = _uvc_conv_stripes(pool, height, min_rows);
+
+  job.taps = (struct resize_tap *) malloc((width + pairs) * sizeof(struct resize_tap) +
+                                          num_stripes * pairs * 4);
+  if (!job.taps)
+    return UVC_ERROR_NO_MEM;
+  job.rows = (uint8_t *) (job.taps + width + pairs);
+
+  job.convert = _uvc_get_yuv422_rgb(uyvy, format == UVC_FRAME_FORMAT_BGR, _uvc_simd_level());
+  job.in = (const uint8_t *) in->data;
+  job.in_step = in_step;
+  job.out = (uint8_t *) out->data;
+  job.out_step = out_step;
+  job.in_width = in->width;
+  job.in_height = in->height;
+  job.out_width = width;
+  job.out_height = height;
+  job.filter = filter;
+  job.y_off = uyvy ? 1 : 0;
+  job.u_off = uyvy ? 0 : 1;
+  resize_taps(job.taps, width, in->width, 2, job.y_off, filter);
+  resize_taps(job.taps + width, pairs, in->width / 2, 4, job.u_off, filter);
+
+  out->width = width;
+  out->height = height;
+  out->frame_format = format;
+  out->step = out_step;
+  out->sequence = in->sequence;
+  out->capture_time = in->capture_time;
+  out->capture_time_finished = in->capture_time_finished;
+  out->source = in->source;
+
+  _uvc_conv_run(pool, num_stripes, yuv422_resize_stripe, &job);
+
+  free(job.taps);
+  return UVC_SUCCESS;
+}
+
+struct nv12_rgb_job {
+  uvc_nv12_rgb_fn convert;
+  const uint8_t *y;
+  const uint8_t *uv;
+  size_t in_step;
+  size_t uv_step;
+  uint8_t *out;
+  size_t out_step;
+  size_t width;
+  size_t height;
+};
+
+static void nv12_rgb_stripe(void *arg, int stripe, int num_stripes) {
+  struct nv12_rgb_job *job = (struct nv12_rgb_job *) arg;
+  size_t row = job->height * stripe / num_stripes;
+  size_t end = job->height * (stripe + 1) / num_stripes;
+
+  for (; row < end; ++row)
+    job->convert(job->y + row * job->in_step, job->uv + row / 2 * job->uv_step,
+                 job->out + row * job->out_step, job->width);
+}
+
+/** @internal
+ * @brief Convert an NV12 frame to packed 24-bit RGB/BGR in row stripes
+ */
+static uvc_error_t convert_nv12_rgb(uvc_frame_t *in, uvc_frame_t *out, int bgr) {
+  struct uvc_conv_pool *pool;
+  struct nv12_rgb_job job;
+  size_t in_step = _uvc_in_step(in, in->width, 0);
+  size_t out_step = _uvc_out_step(out, (size_t) in->width * 3);
+  size_t uv_step = _uvc_chroma_step(UVC_FRAME_FORMAT_NV12, in_step);
+  size_t y_bytes = in_step * in->height;
+  size_t uv_rows = (in->height + 1) / 2;
+  int min_rows = 65536 / (in->width ? in->width : 1);
+
+  if (in->frame_format != UVC_FRAME_FORMAT_NV12 || (in->width & 1) || !in_step || !out_step ||
+      in->data_bytes < y_bytes + (uv_rows ? uv_step * (uv_rows - 1) + in->width : 0))
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (_uvc_ensure_frame_rows(out, out_step, (size_t) in->width * 3, in->height) < 0)
     return UVC_ERROR_NO_MEM;
 
   out->width = in->width;
   out->height = in->height;
-  out->frame_format = UVC_FRAME_FORMAT_RGB;
-  out->step = in->width *3;
+  out->frame_format = bgr ? UVC_FRAME_FORMAT_BGR : UVC_FRAME_FORMAT_RGB;
+  out->step = out_step;
   out->sequence = in->sequence;
   out->capture_time = in->capture_time;
   out->capture_time_finished = in->capture_time_finished;
   out->source = in->source;
 
-  uint8_t *pyuv = (uint8_t *)in->data;
-  uint8_t *prgb = (uint8_t *)out->data;
-  uint8_t *prgb_end = prgb + out->data_bytes;
-
-  while (prgb < prgb_end) {
-    IUYVY2RGB_8(pyuv, prgb);
+  job.convert = _uvc_get_nv12_rgb(bgr, _uvc_simd_level());
+  job.y = (const uint8_t *) in->data;
+  job.uv = job.y + y_bytes;
+  job.in_step = in_step;
+  job.uv_step = uv_step;
+  job.out = (uint8_t *) out->data;
+  job.out_step = out_step;
+  job.width = in->width;
+  job.height = in->height;
 
-    prgb += 3 * 8;
-    pyuv += 2 * 8;
-  }
+  pool = _uvc_frame_conv_pool(in);
+  _uvc_conv_run(pool, _uvc_conv_stripes(pool, in->height, min_rows), nv12_rgb_stripe, &job);
 
   return UVC_SUCCESS;
 }
 
-#define IUYVY2BGR_2(pyuv, pbgr) { \
-    int r = (22987 * ((pyuv)[2] - 128)) >> 14; \
-    int g = (-5636 * ((pyuv)[0] - 128) - 11698 * ((pyuv)[2] - 128)) >> 14; \
-    int b = (29049 * ((pyuv)[0] - 128)) >> 14; \
-    (pbgr)[0] = sat((pyuv)[1] + b); \
-    (pbgr)[1] = sat((pyuv)[1] + g); \
-    (pbgr)[2] = sat((pyuv)[1] + r); \
-    (pbgr)[3] = sat((pyuv)[3] + b); \
-    (pbgr)[4] = sat((pyuv)[3] + g); \
-    (pbgr)[5] = sat((pyuv)[3] + r); \
-    }
-#define IUYVY2BGR_16(pyuv, pbgr) IUYVY2BGR_8(pyuv, pbgr); IUYVY2BGR_8(pyuv + 16, pbgr + 24);
-#define IUYVY2BGR_8(pyuv, pbgr) IUYVY2BGR_4(pyuv, pbgr); IUYVY2BGR_4(pyuv + 8, pbgr + 12);
-#define IUYVY2BGR_4(pyuv, pbgr) IUYVY2BGR_2(pyuv, pbgr); IUYVY2BGR_2(pyuv + 4, pbgr + 6);
+/** @brief Convert a frame from NV12 to RGB
+ * @ingroup frame
+ *
+ * @param in NV12 frame of even width
+ * @param out RGB frame
+ */
+uvc_error_t uvc_nv122rgb(uvc_frame_t *in, uvc_frame_t *out) {
+  return convert_nv12_rgb(in, out, 0);
+}
 
-/** @brief Convert a frame from UYVY to BGR
+/** @brief Convert a frame from NV12 to BGR
  * @ingroup frame
- * @param ini UYVY frame
+ *
+ * @param in NV12 frame of even width
  * @param out BGR frame
  */
-uvc_error_t uvc_uyvy2bgr(uvc_frame_t *in, uvc_frame_t *out) {
-  if (in->frame_format != UVC_FRAME_FORMAT_UYVY)
+uvc_error_t uvc_nv122bgr(uvc_frame_t *in, uvc_frame_t *out) {
+  return convert_nv12_rgb(in, out, 1);
+}
+
+struct gray_job {
+  uvc_gray16_fn gray16;
+  uvc_gray_rgb_fn gray_rgb;
+  int shift;
+  uint16_t offset;
+  const uint8_t *in;
+  size_t in_step;
+  uint8_t *out;
+  size_t out_step;
+  size_t width;
+  size_t height;
+};
+
+/* 16-bit gray to 8-bit gray, or 8- or 16-bit gray to 24-bit pixels. The
+ * last goes through a small buffer of 8-bit pixels that stays in L1. */
+static void gray_stripe(void *arg, int stripe, int num_stripes) {
+  struct gray_job *job = (struct gray_job *) arg;
+  size_t row = job->height * stripe / num_stripes;
+  size_t end = job->height * (stripe + 1) / num_stripes;
+  size_t in_bpp = job->gray16 ? 2 : 1;
+  size_t out_bpp = job->gray_rgb ? 3 : 1;
+  size_t pixels = job->width;
+  size_t rows = end - row;
+
+  /* Packed rows convert as one run */
+  if (job->in_step == job->width * in_bpp && job->out_step == job->width * out_bpp) {
+    pixels *= rows;
+    rows = 1;
+  }
+
+  for (size_t i = 0; i < rows; ++i) {
+    const uint8_t *in = job->in + (row + i) * job->in_step;
+    uint8_t *out = job->out + (row + i) * job->out_step;
+
+    if (!job->gray_rgb) {
+      job->gray16(in, out, pixels, job->shift, job->offset);
+    } else if (!job->gray16) {
+      job->gray_rgb(in, out, pixels);
+    } else {
+      uint8_t buf[1024];
+
+      for (size_t done = 0; done < pixels; ) {
+        size_t n = std::min(pixels - done, sizeof(buf));
+
+        job->gray16(in + done * 2, buf, n, job->shift, job->offset);
+        job->gray_rgb(buf, out + done * 3, n);
+        done += n;
+      }
+    }
+  }
+}
+
+/** @internal
+ * @brief Convert a GRAY8 or GRAY16 frame to GRAY8 or 24-bit RGB/BGR
+ */
+static uvc_error_t convert_gray(uvc_frame_t *in, uvc_frame_t *out,
+    enum uvc_frame_format format, int shift, uint16_t offset) {
+  struct uvc_conv_pool *pool;
+  struct gray_job job;
+  size_t out_bpp = format == UVC_FRAME_FORMAT_GRAY8 ? 1 : 3;
+  int gray16 = in->frame_format == UVC_FRAME_FORMAT_GRAY16;
+  size_t in_step = _uvc_in_step(in, (size_t) in->width * (gray16 ? 2 : 1), in->height);
+  size_t out_step = _uvc_out_step(out, (size_t) in->width * out_bpp);
+  int min_rows = 65536 / (in->width ? in->width : 1);
+
+  if (!in_step || !out_step)
     return UVC_ERROR_INVALID_PARAM;
 
-  if (uvc_ensure_frame_size(out, in->width * in->height * 3) < 0)
+  if (_uvc_ensure_frame_rows(out, out_step, (size_t) in->width * out_bpp, in->height) < 0)
     return UVC_ERROR_NO_MEM;
 
   out->width = in->width;
   out->height = in->height;
-  out->frame_format = UVC_FRAME_FORMAT_BGR;
-  out->step = in->width *3;
+  out->frame_format = format;
+  out->step = out_step;
   out->sequence = in->sequence;
   out->capture_time = in->capture_time;
   out->capture_time_finished = in->capture_time_finished;
   out->source = in->source;
 
-  uint8_t *pyuv = (uint8_t *)in->data;
-  uint8_t *pbgr = (uint8_t *)out->data;
-  uint8_t *pbgr_end = pbgr + out->data_bytes;
+  job.gray16 = gray16 ? _uvc_get_gray16(_uvc_simd_level()) : NULL;
+  job.gray_rgb = out_bpp == 3 ? _uvc_get_gray_rgb(_uvc_simd_level()) : NULL;
+  job.shift = shift;
+  job.offset = offset;
+  job.in = (const uint8_t *) in->data;
+  job.in_step = in_step;
+  job.out = (uint8_t *) out->data;
+  job.out_step = out_step;
+  job.width = in->width;
+  job.height = in->height;
+
+  pool = _uvc_frame_conv_pool(in);
+  _uvc_conv_run(pool, _uvc_conv_stripes(pool, in->height, min_rows), gray_stripe, &job);
 
-  while (pbgr < pbgr_end) {
-    IUYVY2BGR_8(pyuv, pbgr);
+  return UVC_SUCCESS;
+}
 
-    pbgr += 3 * 8;
-    pyuv += 2 * 8;
+/** @brief Convert a frame from GRAY16 to GRAY8 through a window
+ * @ingroup frame
+ *
+ * Each pixel becomes (value - offset) >> shift, clamped to [0, 255], so
+ * the window [offset, offset + (256 << shift)) spans the output range.
+ * A shift of 8 and an offset of 0 keep the top byte; sensors that fill
+ * only the low 10 or 12 bits want a shift of 2 or 4.
+ *
+ * @param in GRAY16 frame, little-endian
+ * @param out GRAY8 frame
+ * @param shift Right shift, 0 to 15
+ * @param offset Value mapped to black
+ */
+uvc_error_t uvc_gray162gray(uvc_frame_t *in, uvc_frame_t *out, int shift, uint16_t offset) {
+  if (in->frame_format != UVC_FRAME_FORMAT_GRAY16 || shift < 0 || shift > 15)
+    return UVC_ERROR_INVALID_PARAM;
+
+  return convert_gray(in, out, UVC_FRAME_FORMAT_GRAY8, shift, offset);
+}
+
+/** @internal
+ * @brief Pattern bits (see uvc_bayer_rgb_fn) of the first row of a Bayer format
+ */
+static int bayer_pattern(enum uvc_frame_format format) {
+  switch (format) {
+  case UVC_FRAME_FORMAT_SRGGB8:
+    return 2;
+  case UVC_FRAME_FORMAT_SGRBG8:
+    return 3;
+  case UVC_FRAME_FORMAT_SGBRG8:
+    return 1;
+  case UVC_FRAME_FORMAT_SBGGR8:
+  case UVC_FRAME_FORMAT_BA81:
+    return 0;
+  default:
+    return -1;
   }
+}
+
+struct bayer_rgb_job {
+  uvc_bayer_rgb_fn demosaic;
+  int pattern;
+  const uint8_t *in;
+  size_t in_step;
+  uint8_t *out;
+  size_t out_step;
+  size_t width;
+  size_t height;
+};
+
+static void bayer_rgb_stripe(void *arg, int stripe, int num_stripes) {
+  struct bayer_rgb_job *job = (struct bayer_rgb_job *) arg;
+  size_t row = job->height * stripe / num_stripes;
+  size_t end = job->height * (stripe + 1) / num_stripes;
+  size_t step = job->in_step;
+
+  /* The first and last rows mirror their neighbour, which has the
+   * colours the missing row would have had */
+  for (; row < end; ++row) {
+    size_t above = row > 0 ? row - 1 : row + 1;
+    size_t below = row + 1 < job->height ? row + 1 : row - 1;
+
+    job->demosaic(job->in + above * step, job->in + row * step, job->in + below * step,
+                  job->out + row * job->out_step, job->width,
+                  job->pattern ^ (row & 1 ? 3 : 0));
+  }
+}
+
+/** @internal
+ * @brief Demosaic an 8-bit Bayer frame to packed 24-bit RGB/BGR in row stripes
+ */
+static uvc_error_t convert_bayer_rgb(uvc_frame_t *in, uvc_frame_t *out, int bgr) {
+  struct uvc_conv_pool *pool;
+  struct bayer_rgb_job job;
+  size_t in_step = _uvc_in_step(in, in->width, in->height);
+  size_t out_step = _uvc_out_step(out, (size_t) in->width * 3);
+  int pattern = bayer_pattern(in->frame_format);
+  int min_rows = 65536 / (in->width ? in->width : 1);
+
+  if (pattern < 0)
+    return UVC_ERROR_NOT_SUPPORTED;
+
+  if (in->width < 2 || in->height < 2 || !in_step || !out_step)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (_uvc_ensure_frame_rows(out, out_step, (size_t) in->width * 3, in->height) < 0)
+    return UVC_ERROR_NO_MEM;
+
+  out->width = in->width;
+  out->height = in->height;
+  out->frame_format = bgr ? UVC_FRAME_FORMAT_BGR : UVC_FRAME_FORMAT_RGB;
+  out->step = out_step;
+  out->sequence = in->sequence;
+  out->capture_time = in->capture_time;
+  out->capture_time_finished = in->capture_time_finished;
+  out->source = in->source;
+
+  job.demosaic = _uvc_get_bayer_rgb(bgr, _uvc_simd_level());
+  job.pattern = pattern;
+  job.in = (const uint8_t *) in->data;
+  job.in_step = in_step;
+  job.out = (uint8_t *) out->data;
+  job.out_step = out_step;
+  job.width = in->width;
+  job.height = in->height;
+
+  pool = _uvc_frame_conv_pool(in);
+  _uvc_conv_run(pool, _uvc_conv_stripes(pool, in->height, min_rows), bayer_rgb_stripe, &job);
+
+  return UVC_SUCCESS;
+}
+
+/** @brief Demosaic a Bayer frame to RGB
+ * @ingroup frame
+ *
+ * Bilinear interpolation: each missing colour is the mean of the nearest
+ * pixels of that colour.
+ *
+ * @param in UVC_FRAME_FORMAT_SRGGB8, SGRBG8, SGBRG8, SBGGR8 or BA81 frame
+ * @param out RGB frame
+ * @return UVC_ERROR_NOT_SUPPORTED for other formats, including BY8, whose
+ * colour order depends on the camera
+ */
+uvc_error_t uvc_bayer2rgb(uvc_frame_t *in, uvc_frame_t *out) {
+  return convert_bayer_rgb(in, out, 0);
+}
+
+/** @brief Demosaic a Bayer frame to BGR
+ * @ingroup frame
+ *
+ * @param in Bayer frame, as for uvc_bayer2rgb()
+ * @param out BGR frame
+ */
+uvc_error_t uvc_bayer2bgr(uvc_frame_t *in, uvc_frame_t *out) {
+  return convert_bayer_rgb(in, out, 1);
+}
+
+/** @internal
+ * @brief Check the marker structure of a JPEG image without decoding it
+ *
+ * Walks the header segments and scans the entropy-coded data for markers,
+ * which costs a memchr() over the image. Catches the damage a lossy link
+ * does: a missing SOI or EOI, a segment running past the end, a scan
+ * without a frame header, a stray marker, or a restart marker out of
+ * sequence where payloads were lost. Zero padding after the EOI, as some
+ * devices send, is allowed.
+ *
+ * @return 1 if the image looks complete, 0 otherwise
+ */
+int _uvc_mjpeg_valid(const uint8_t *data, size_t data_bytes) {
+  const uint8_t *p = data;
+  size_t end = data_bytes;
+  size_t pos = 2;
+  int have_frame = 0;
+
+  while (end > 4 && p[end - 1] == 0)
+    --end;
+
+  if (end < 4 || p[0] != 0xff || p[1] != 0xd8 ||
+      p[end - 2] != 0xff || p[end - 1] != 0xd9)
+    return 0;
+
+  for (;;) {
+    uint8_t marker;
+    size_t len;
+
+    if (pos + 4 > end || p[pos] != 0xff)
+      return 0;
+
+    marker = p[pos + 1];
+    if (marker == 0xff) {
+      ++pos;
+      continue;
+    }
+    if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+      pos += 2;
+      continue;
+    }
+    if (marker == 0xd8 || marker == 0xd9 || marker == 0x00)
+      return 0;
+
+    len = (p[pos + 2] << 8) | p[pos + 3];
+    if (len < 2 || pos + 2 + len > end)
+      return 0;
+
+    if (marker >= 0xc0 && marker <= 0xcf &&
+        marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+      /* Frame header: a size and 1 to 4 components */
+      const uint8_t *seg = p + pos + 4;
+      int num_comps;
+
+      if (len < 8)
+        return 0;
+      num_comps = seg[5];
+      if (num_comps < 1 || num_comps > 4 || len != 8 + 3 * (size_t) num_comps ||
+          ((seg[3] << 8) | seg[4]) == 0)
+        return 0;
+      have_frame = 1;
+    }
+
+    pos += 2 + len;
+    if (marker != 0xda)
+      continue;
+
+    if (!have_frame)
+      return 0;
+
+    /* Entropy-coded data runs to the next marker other than a stuffed
+     * zero, fill byte or restart */
+    for (int next_rst = 0; ; ) {
+      const uint8_t *ff = (const uint8_t *) memchr(p + pos, 0xff, end - pos);
+
+      if (!ff)
+        return 0;
+      pos = ff - p;
+      if (pos + 1 >= end)
+        return 0;
+
+      marker = p[pos + 1];
+      if (marker == 0x00) {
+        pos += 2;
+      } else if (marker == 0xff) {
+        ++pos;
+      } else if (marker >= 0xd0 && marker <= 0xd7) {
+        if (marker != 0xd0 + next_rst)
+          return 0;
+        next_rst = (next_rst + 1) & 7;
+        pos += 2;
+      } else {
+        break;
+      }
+    }
+
+    /* The EOI ends the image; anything else starts another scan's tables */
+    if (p[pos + 1] == 0xd9)
+      return pos + 2 == end;
+  }
+}
+
+/** @brief Check that an MJPEG frame is complete before decoding it
+ * @ingroup frame
+ *
+ * A truncated or damaged frame otherwise costs a libjpeg decode up to
+ * the point of failure. This walks the frame's markers instead, at a
+ * small fraction of the cost of decoding it; see
+ * UVC_STREAM_FLAG_DROP_CORRUPT to apply it to every frame of a stream.
+ * Damage inside the entropy-coded data between two markers is not
+ * detected.
+ *
+ * @param frame MJPEG frame
+ * @return UVC_ERROR_INVALID_PARAM if the frame is not MJPEG,
+ * UVC_ERROR_OTHER if it is truncated or corrupt
+ */
+uvc_error_t uvc_mjpeg_validate(uvc_frame_t *frame) {
+  if (frame->frame_format != UVC_FRAME_FORMAT_MJPEG)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (!_uvc_mjpeg_valid((const uint8_t *) frame->data, frame->data_bytes))
+    return UVC_ERROR_OTHER;
 
   return UVC_SUCCESS;
 }
@@ -435,6 +1332,9 @@ uvc_error_t uvc_uyvy2bgr(uvc_frame_t *in, uvc_frame_t *out) {
 /** @brief Convert a frame to RGB
  * @ingroup frame
  *
+ * Handles YUYV, UYVY, NV12, GRAY8, GRAY16 (its top 8 bits) and the
+ * Bayer formats uvc_bayer2rgb() takes.
+ *
  * @param in non-RGB frame
  * @param out RGB frame
  */
@@ -444,6 +1344,17 @@ uvc_error_t uvc_any2rgb(uvc_frame_t *in, uvc_frame_t *out) {
       return uvc_yuyv2rgb(in, out);
     case UVC_FRAME_FORMAT_UYVY:
       return uvc_uyvy2rgb(in, out);
+    case UVC_FRAME_FORMAT_NV12:
+      return uvc_nv122rgb(in, out);
+    case UVC_FRAME_FORMAT_GRAY8:
+    case UVC_FRAME_FORMAT_GRAY16:
+      return convert_gray(in, out, UVC_FRAME_FORMAT_RGB, 8, 0);
+    case UVC_FRAME_FORMAT_SRGGB8:
+    case UVC_FRAME_FORMAT_SGRBG8:
+    case UVC_FRAME_FORMAT_SGBRG8:
+    case UVC_FRAME_FORMAT_SBGGR8:
+    case UVC_FRAME_FORMAT_BA81:
+      return uvc_bayer2rgb(in, out);
     case UVC_FRAME_FORMAT_RGB:
       return uvc_duplicate_frame(in, out);
     default:
@@ -454,6 +1365,8 @@ uvc_error_t uvc_any2rgb(uvc_frame_t *in, uvc_frame_t *out) {
 /** @brief Convert a frame to BGR
  * @ingroup frame
  *
+ * Handles the same formats as uvc_any2rgb().
+ *
  * @param in non-BGR frame
  * @param out BGR frame
  */
@@ -463,9 +1376,320 @@ uvc_error_t uvc_any2bgr(uvc_frame_t *in, uvc_frame_t *out) {
       return uvc_yuyv2bgr(in, out);
     case UVC_FRAME_FORMAT_UYVY:
       return uvc_uyvy2bgr(in, out);
+    case UVC_FRAME_FORMAT_NV12:
+      return uvc_nv122bgr(in, out);
+    case UVC_FRAME_FORMAT_GRAY8:
+    case UVC_FRAME_FORMAT_GRAY16:
+      return convert_gray(in, out, UVC_FRAME_FORMAT_BGR, 8, 0);
+    case UVC_FRAME_FORMAT_SRGGB8:
+    case UVC_FRAME_FORMAT_SGRBG8:
+    case UVC_FRAME_FORMAT_SGBRG8:
+    case UVC_FRAME_FORMAT_SBGGR8:
+    case UVC_FRAME_FORMAT_BA81:
+      return uvc_bayer2bgr(in, out);
     case UVC_FRAME_FORMAT_BGR:
       return uvc_duplicate_frame(in, out);
     default:
       return UVC_ERROR_NOT_SUPPORTED;
   }
 }
+
+/** @internal
+ * @brief Copy the luma plane of an NV12 or I420 frame to a GRAY8 frame
+ */
+static uvc_error_t yuv420_luma(uvc_frame_t *in, uvc_frame_t *out) {
+  size_t in_step = _uvc_in_step(in, in->width, in->height);
+  size_t out_step = _uvc_out_step(out, in->width);
+
+  if (!in->height || !in_step || !out_step)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (_uvc_ensure_frame_rows(out, out_step, in->width, in->height) < 0)
+    return UVC_ERROR_NO_MEM;
+
+  out->width = in->width;
+  out->height = in->height;
+  out->frame_format = UVC_FRAME_FORMAT_GRAY8;
+  out->step = out_step;
+  out->sequence = in->sequence;
+  out->capture_time = in->capture_time;
+  out->capture_time_finished = in->capture_time_finished;
+  out->source = in->source;
+
+  if (in_step == out_step) {
+    memcpy(out->data, in->data, out_step * (in->height - 1) + in->width);
+  } else {
+    for (uint32_t row = 0; row < in->height; ++row)
+      memcpy((uint8_t *) out->data + row * out_step,
+             (const uint8_t *) in->data + row * in_step, in->width);
+  }
+
+  return UVC_SUCCESS;
+}
+
+static uvc_error_t uyvy2y(uvc_frame_t *in, uvc_frame_t *out) {
+  return convert_yuv422_y(in, out, 1);
+}
+
+static uvc_error_t gray2rgb(uvc_frame_t *in, uvc_frame_t *out) {
+  return convert_gray(in, out, UVC_FRAME_FORMAT_RGB, 8, 0);
+}
+
+static uvc_error_t gray2bgr(uvc_frame_t *in, uvc_frame_t *out) {
+  return convert_gray(in, out, UVC_FRAME_FORMAT_BGR, 8, 0);
+}
+
+static uvc_error_t gray162gray8(uvc_frame_t *in, uvc_frame_t *out) {
+  return convert_gray(in, out, UVC_FRAME_FORMAT_GRAY8, 8, 0);
+}
+
+/** @internal
+ * @brief Swap the red and blue channels of an RGB or BGR frame
+ */
+static uvc_error_t rgb_swap(uvc_frame_t *in, uvc_frame_t *out) {
+  size_t row_bytes = (size_t) in->width * 3;
+  size_t in_step = _uvc_in_step(in, row_bytes, in->height);
+  size_t out_step = _uvc_out_step(out, row_bytes);
+
+  if (!in_step || !out_step)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (_uvc_ensure_frame_rows(out, out_step, row_bytes, in->height) < 0)
+    return UVC_ERROR_NO_MEM;
+
+  out->width = in->width;
+  out->height = in->height;
+  out->frame_format = in->frame_format == UVC_FRAME_FORMAT_RGB ?
+      UVC_FRAME_FORMAT_BGR : UVC_FRAME_FORMAT_RGB;
+  out->step = out_step;
+  out->sequence = in->sequence;
+  out->capture_time = in->capture_time;
+  out->capture_time_finished = in->capture_time_finished;
+  out->source = in->source;
+
+  for (uint32_t row = 0; row < in->height; ++row) {
+    const uint8_t *src = (const uint8_t *) in->data + row * in_step;
+    uint8_t *dst = (uint8_t *) out->data + row * out_step;
+
+    for (size_t i = 0; i < row_bytes; i += 3) {
+      uint8_t first = src[i];
+
+      dst[i] = src[i + 2];
+      dst[i + 1] = src[i + 1];
+      dst[i + 2] = first;
+    }
+  }
+
+  return UVC_SUCCESS;
+}
+
+/** One conversion uvc_convert() can chain */
+struct convert_edge {
+  enum uvc_frame_format from;
+  enum uvc_frame_format to;
+  /** Hundredths of a nanosecond per pixel on one x86 core with AVX2, from
+   * uvc_bench at 1080p. Only the ordering matters. */
+  unsigned cost;
+  uvc_error_t (*convert)(uvc_frame_t *in, uvc_frame_t *out);
+};
+
+static const struct convert_edge convert_edges[] = {
+  {UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_RGB, 35, uvc_yuyv2rgb},
+  {UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_BGR, 35, uvc_yuyv2bgr},
+  {UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_I420, 19, uvc_yuyv2i420},
+  {UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_NV12, 19, uvc_yuyv2nv12},
+  {UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_GRAY8, 16, uvc_yuyv2y},
+  {UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_RGB, 35, uvc_uyvy2rgb},
+  {UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_BGR, 35, uvc_uyvy2bgr},
+  {UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_I420, 19, uvc_uyvy2i420},
+  {UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_NV12, 19, uvc_uyvy2nv12},
+  {UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_GRAY8, 16, uyvy2y},
+  {UVC_FRAME_FORMAT_RGB, UVC_FRAME_FORMAT_BGR, 126, rgb_swap},
+  {UVC_FRAME_FORMAT_BGR, UVC_FRAME_FORMAT_RGB, 126, rgb_swap},
+  {UVC_FRAME_FORMAT_NV12, UVC_FRAME_FORMAT_RGB, 58, uvc_nv122rgb},
+  {UVC_FRAME_FORMAT_NV12, UVC_FRAME_FORMAT_BGR, 58, uvc_nv122bgr},
+  {UVC_FRAME_FORMAT_NV12, UVC_FRAME_FORMAT_GRAY8, 9, yuv420_luma},
+  {UVC_FRAME_FORMAT_I420, UVC_FRAME_FORMAT_GRAY8, 9, yuv420_luma},
+  {UVC_FRAME_FORMAT_GRAY8, UVC_FRAME_FORMAT_RGB, 26, gray2rgb},
+  {UVC_FRAME_FORMAT_GRAY8, UVC_FRAME_FORMAT_BGR, 26, gray2bgr},
+  {UVC_FRAME_FORMAT_GRAY16, UVC_FRAME_FORMAT_RGB, 53, gray2rgb},
+  {UVC_FRAME_FORMAT_GRAY16, UVC_FRAME_FORMAT_BGR, 53, gray2bgr},
+  {UVC_FRAME_FORMAT_GRAY16, UVC_FRAME_FORMAT_GRAY8, 13, gray162gray8},
+  {UVC_FRAME_FORMAT_SRGGB8, UVC_FRAME_FORMAT_RGB, 115, uvc_bayer2rgb},
+  {UVC_FRAME_FORMAT_SRGGB8, UVC_FRAME_FORMAT_BGR, 115, uvc_bayer2bgr},
+  {UVC_FRAME_FORMAT_SGRBG8, UVC_FRAME_FORMAT_RGB, 115, uvc_bayer2rgb},
+  {UVC_FRAME_FORMAT_SGRBG8, UVC_FRAME_FORMAT_BGR, 115, uvc_bayer2bgr},
+  {UVC_FRAME_FORMAT_SGBRG8, UVC_FRAME_FORMAT_RGB, 115, uvc_bayer2rgb},
+  {UVC_FRAME_FORMAT_SGBRG8, UVC_FRAME_FORMAT_BGR, 115, uvc_bayer2bgr},
+  {UVC_FRAME_FORMAT_SBGGR8, UVC_FRAME_FORMAT_RGB, 115, uvc_bayer2rgb},
+  {UVC_FRAME_FORMAT_SBGGR8, UVC_FRAME_FORMAT_BGR, 115, uvc_bayer2bgr},
+  {UVC_FRAME_FORMAT_BA81, UVC_FRAME_FORMAT_RGB, 115, uvc_bayer2rgb},
+  {UVC_FRAME_FORMAT_BA81, UVC_FRAME_FORMAT_BGR, 115, uvc_bayer2bgr},
+#ifdef LIBUVC_HAS_JPEG
+  {UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_RGB, 702, uvc_mjpeg2rgb},
+  {UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_GRAY8, 643, uvc_mjpeg2gray},
+  {UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_I420, 656, uvc_mjpeg2i420},
+  {UVC_FRAME_FORMAT_MJPEG, UVC_FRAME_FORMAT_NV12, 649, uvc_mjpeg2nv12},
+#endif
+};
+
+/** Most conversions uvc_convert() chains for one frame */
+#define CONVERT_MAX_STEPS 3
+
+/** @internal
+ * @brief Chroma resolution a format holds: 0 none, 1 4:2:0, 2 4:2:2, 3 full
+ */
+static int chroma_detail(enum uvc_frame_format format) {
+  switch (format) {
+  case UVC_FRAME_FORMAT_GRAY8:
+  case UVC_FRAME_FORMAT_GRAY16:
+    return 0;
+  case UVC_FRAME_FORMAT_NV12:
+  case UVC_FRAME_FORMAT_I420:
+    return 1;
+  case UVC_FRAME_FORMAT_YUYV:
+  case UVC_FRAME_FORMAT_UYVY:
+    return 2;
+  default:
+    return 3;
+  }
+}
+
+static int sample_bits(enum uvc_frame_format format) {
+  return format == UVC_FRAME_FORMAT_GRAY16 ? 16 : 8;
+}
+
+/** @internal
+ * @brief Find the cheapest chain of conversions between two formats
+ *
+ * A shortest-path search over convert_edges bounded to CONVERT_MAX_STEPS
+ * hops; of equally cheap chains the shortest wins. Intermediate formats
+ * must keep as much chroma and bit depth as the less detailed of the two
+ * ends, so a cheap detour cannot cost the output quality: MJPEG does not
+ * reach RGB through GRAY8, nor YUYV through NV12.
+ *
+ * @param[out] path Edges to apply in order
+ * @return Number of edges in @p path, 0 if there is no chain
+ */
+static int convert_path(enum uvc_frame_format from, enum uvc_frame_format to,
+    const struct convert_edge **path) {
+  const size_t num_edges = sizeof(convert_edges) / sizeof(convert_edges[0]);
+  unsigned cost[CONVERT_MAX_STEPS + 1][UVC_FRAME_FORMAT_COUNT];
+  int via[CONVERT_MAX_STEPS + 1][UVC_FRAME_FORMAT_COUNT];
+  int chroma = std::min(chroma_detail(from), chroma_detail(to));
+  int bits = std::min(sample_bits(from), sample_bits(to));
+  unsigned best_cost = UINT_MAX;
+  int steps = 0;
+
+  for (int k = 0; k <= CONVERT_MAX_STEPS; ++k) {
+    for (int f = 0; f < UVC_FRAME_FORMAT_COUNT; ++f)
+      cost[k][f] = UINT_MAX;
+  }
+  cost[0][from] = 0;
+
+  for (int k = 1; k <= CONVERT_MAX_STEPS; ++k) {
+    for (size_t i = 0; i < num_edges; ++i) {
+      const struct convert_edge *e = &convert_edges[i];
+
+      if (e->to != to &&
+          (chroma_detail(e->to) < chroma || sample_bits(e->to) < bits))
+        continue;
+
+      if (cost[k - 1][e->from] != UINT_MAX &&
+          cost[k - 1][e->from] + e->cost < cost[k][e->to]) {
+        cost[k][e->to] = cost[k - 1][e->from] + e->cost;
+        via[k][e->to] = i;
+      }
+    }
+
+    if (cost[k][to] < best_cost) {
+      best_cost = cost[k][to];
+      steps = k;
+    }
+  }
+
+  for (int k = steps, f = to; k > 0; --k) {
+    path[k - 1] = &convert_edges[via[k][f]];
+    f = path[k - 1]->from;
+  }
+
+  return steps;
+}
+
+/** @internal
+ * @brief The calling thread's intermediate frames, created on first use
+ *
+ * Each keeps its buffer between calls, so a stream converting frames of
+ * one size allocates only on its first frame.
+ */
+static uvc_frame_t *thread_intermediate(int i) {
+  struct holder {
+    uvc_frame_t *frames[CONVERT_MAX_STEPS - 1];
+    holder() : frames() {}
+    ~holder() {
+      for (int i = 0; i < CONVERT_MAX_STEPS - 1; ++i) {
+        if (frames[i])
+          uvc_free_frame(frames[i]);
+      }
+    }
+  };
+  static thread_local holder local;
+
+  if (!local.frames[i])
+    local.frames[i] = uvc_allocate_frame(0);
+
+  return local.frames[i];
+}
+
+/** @brief Convert a frame to another format by the cheapest available route
+ * @ingroup frame
+ *
+ * Picks the cheapest chain of the library's converters from the input's
+ * format to @p format, going direct when a single converter does the
+ * job. MJPEG to BGR, which libjpeg does not produce, decodes to RGB and
+ * swaps channels. No chain passes through a format with less chroma or
+ * bit depth than both the input and the output keep, so a detour saves
+ * time without losing detail.
+ * Intermediate frames belong to the calling thread and are reused from
+ * call to call, so a steady stream of frames does not allocate. The same
+ * format as the input duplicates the frame.
+ *
+ * Only @p out takes a caller-supplied step; intermediates are packed.
+ *
+ * @param in Input frame
+ * @param out Output frame
+ * @param format Output format
+ * @return UVC_ERROR_NOT_SUPPORTED if no chain of converters reaches @p format
+ */
+uvc_error_t uvc_convert(uvc_frame_t *in, uvc_frame_t *out, enum uvc_frame_format format) {
+  const struct convert_edge *path[CONVERT_MAX_STEPS];
+  uvc_frame_t *src = in;
+  int steps;
+
+  if (in->frame_format <= UVC_FRAME_FORMAT_COMPRESSED ||
+      in->frame_format >= UVC_FRAME_FORMAT_COUNT ||
+      format <= UVC_FRAME_FORMAT_COMPRESSED || format >= UVC_FRAME_FORMAT_COUNT)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (in->frame_format == format)
+    return uvc_duplicate_frame(in, out);
+
+  steps = convert_path(in->frame_format, format, path);
+  if (!steps)
+    return UVC_ERROR_NOT_SUPPORTED;
+
+  for (int i = 0; i < steps; ++i) {
+    uvc_frame_t *dst = i == steps - 1 ? out : thread_intermediate(i);
+    uvc_error_t ret;
+
+    if (!dst)
+      return UVC_ERROR_NO_MEM;
+
+    ret = path[i]->convert(src, dst);
+    if (ret != UVC_SUCCESS)
+      return ret;
+    src = dst;
+  }
+
+  return UVC_SUCCESS;
+}
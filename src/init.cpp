@@ -42,6 +42,7 @@ for USB Video Class (UVC) devices, such as consumer webcams.
 \li \ref streaming "Video streaming" (device to host) with asynchronous/callback and synchronous/polling modes
 \li Read/write access to standard \ref ctrl "device settings"
 \li \ref frame "Conversion" between various formats: RGB, YUV, JPEG, etc.
+\li \ref replay "Capture and replay" of a stream's USB transfers, for testing without a camera
 \li Tested on Mac and Linux, portable to Windows and some BSDs
 
 \section roadmap Roadmap
@@ -145,6 +146,8 @@ void uvc_exit(uvc_context_t *ctx) {
   if (ctx->own_usb_ctx)
     libusb_exit(ctx->usb_ctx);
 
+  _uvc_conv_pool_free(ctx->conv_pool);
+
   delete ctx;
 }
 
@@ -0,0 +1,523 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (C) 2010-2012 Ken Tossell
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the author nor other contributors may be
+*     used to endorse or promote products derived from this software
+*     without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+/**
+ * @defgroup replay Capture and replay
+ * @brief Record a stream's USB transfers and play them back without a device
+ *
+ * A capture records every completed transfer of a stream, with its status,
+ * isochronous packet descriptors and payload bytes. A replay stream feeds a
+ * capture back through the same payload path a camera would, either at the
+ * recorded pace or as fast as possible, so the streaming engine can be
+ * exercised and benchmarked on a machine without the camera.
+ */
+
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+#if _WIN32
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+uvc_frame_desc_t *uvc_find_frame_desc_stream(uvc_stream_handle_t *strmh,
+    uint16_t format_id, uint16_t frame_id);
+
+/** An open capture file */
+struct uvc_capture {
+  FILE *file;
+  std::chrono::steady_clock::time_point start_time;
+  /** Set once a write fails; nothing more is recorded */
+  uint8_t failed;
+};
+
+/** The stand-in device and the mapped capture file of a replay stream */
+struct uvc_replay {
+  uvc_device_handle_t devh;
+  uvc_streaming_interface_t stream_if;
+  uvc_format_desc_t format_desc;
+  uvc_frame_desc_t frame_desc;
+  uint8_t flags;
+  const uint8_t *data;
+  size_t size;
+#if _WIN32
+  std::vector<uint8_t> contents;
+#endif
+  /** Stands in for the DMA buffer of a bulk transfer */
+  uint8_t *transfer_buf;
+  std::thread thread;
+
+  uvc_replay()
+    : flags(0)
+    , data(nullptr)
+    , size(0)
+    , transfer_buf(nullptr) {
+    memset(&stream_if, 0, sizeof(stream_if));
+  }
+
+  ~uvc_replay() {
+    free(transfer_buf);
+#if !_WIN32
+    if (data)
+      munmap((void *) data, size);
+#endif
+  }
+};
+
+static size_t _uvc_capture_padding(size_t len) {
+  return (8 - (len & 7)) & 7;
+}
+
+/** @brief Start recording a stream's transfers to a file
+ * @ingroup replay
+ *
+ * Every transfer the stream completes from now on is appended to the file,
+ * which can later be played back with uvc_stream_open_replay(). Call this
+ * while the stream is stopped, typically right before uvc_stream_start().
+ *
+ * @param strmh UVC stream, opened but not running
+ * @param path File to create (overwritten if it exists)
+ * @return UVC_ERROR_BUSY if the stream is running or already capturing
+ */
+uvc_error_t uvc_stream_start_capture(uvc_stream_handle_t *strmh, const char *path) {
+  struct uvc_capture_file_header header;
+  uvc_frame_desc_t *frame_desc;
+  struct uvc_capture *capture;
+
+  if (strmh->running || strmh->capture)
+    return UVC_ERROR_BUSY;
+
+  frame_desc = uvc_find_frame_desc_stream(strmh, strmh->cur_ctrl.bFormatIndex,
+                                          strmh->cur_ctrl.bFrameIndex);
+  if (!frame_desc)
+    return UVC_ERROR_INVALID_PARAM;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, UVC_CAPTURE_MAGIC, sizeof(header.magic));
+  header.version = UVC_CAPTURE_VERSION;
+  header.header_bytes = sizeof(header);
+  memcpy(header.guidFormat, frame_desc->parent->guidFormat, sizeof(header.guidFormat));
+  header.bDescriptorSubtype = frame_desc->parent->bDescriptorSubtype;
+  header.is_isight = strmh->devh->is_isight;
+  header.wWidth = frame_desc->wWidth;
+  header.wHeight = frame_desc->wHeight;
+  header.dwFrameInterval = strmh->cur_ctrl.dwFrameInterval;
+  header.dwMaxVideoFrameSize = strmh->cur_ctrl.dwMaxVideoFrameSize;
+  header.dwMaxPayloadTransferSize = strmh->cur_ctrl.dwMaxPayloadTransferSize;
+
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return UVC_ERROR_ACCESS;
+
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    fclose(file);
+    return UVC_ERROR_IO;
+  }
+
+  capture = new uvc_capture();
+  capture->file = file;
+  capture->start_time = std::chrono::steady_clock::now();
+  capture->failed = 0;
+  strmh->capture = capture;
+
+  return UVC_SUCCESS;
+}
+
+/** @brief Stop recording a stream and close the capture file
+ * @ingroup replay
+ *
+ * Captures are also closed by uvc_stream_close().
+ *
+ * @param strmh UVC stream, not running
+ * @return UVC_ERROR_BUSY if the stream is running, UVC_ERROR_IO if any part of
+ * the capture could not be written
+ */
+uvc_error_t uvc_stream_stop_capture(uvc_stream_handle_t *strmh) {
+  struct uvc_capture *capture = strmh->capture;
+
+  if (strmh->running)
+    return UVC_ERROR_BUSY;
+  if (!capture)
+    return UVC_ERROR_INVALID_PARAM;
+
+  strmh->capture = NULL;
+  return _uvc_capture_close(capture);
+}
+
+/** @internal
+ * @brief Flush and free a capture
+ * @return UVC_ERROR_IO if any part of the capture could not be written
+ */
+uvc_error_t _uvc_capture_close(struct uvc_capture *capture) {
+  uvc_error_t ret = capture->failed ? UVC_ERROR_IO : UVC_SUCCESS;
+
+  if (fclose(capture->file) != 0)
+    ret = UVC_ERROR_IO;
+  delete capture;
+
+  return ret;
+}
+
+/** @internal
+ * @brief Append a completed transfer to the capture file
+ *
+ * Called from the transfer callback before the transfer is processed.
+ */
+void _uvc_capture_transfer(struct uvc_capture *capture, struct libusb_transfer *transfer) {
+  static const uint8_t zeros[8] = {0};
+  struct uvc_capture_record record;
+  size_t len;
+  int i;
+
+  if (capture->failed)
+    return;
+
+  record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - capture->start_time).count();
+  record.status = transfer->status;
+  record.num_iso_packets = transfer->num_iso_packets;
+  record.data_bytes = 0;
+
+  if (transfer->num_iso_packets == 0) {
+    record.data_bytes = transfer->actual_length;
+  } else {
+    for (i = 0; i < transfer->num_iso_packets; ++i)
+      record.data_bytes += transfer->iso_packet_desc[i].actual_length;
+  }
+
+  len = sizeof(record) + record.num_iso_packets * sizeof(struct uvc_capture_iso_packet) +
+        record.data_bytes;
+  record.record_bytes = len + _uvc_capture_padding(len);
+
+  if (fwrite(&record, sizeof(record), 1, capture->file) != 1)
+    goto fail;
+
+  if (transfer->num_iso_packets == 0) {
+    if (fwrite(transfer->buffer, 1, record.data_bytes, capture->file) != record.data_bytes)
+      goto fail;
+  } else {
+    for (i = 0; i < transfer->num_iso_packets; ++i) {
+      struct uvc_capture_iso_packet pkt;
+
+      pkt.actual_length = transfer->iso_packet_desc[i].actual_length;
+      pkt.status = transfer->iso_packet_desc[i].status;
+      if (fwrite(&pkt, sizeof(pkt), 1, capture->file) != 1)
+        goto fail;
+    }
+
+    for (i = 0; i < transfer->num_iso_packets; ++i) {
+      size_t pkt_len = transfer->iso_packet_desc[i].actual_length;
+      uint8_t *pktbuf = libusb_get_iso_packet_buffer_simple(transfer, i);
+
+      if (fwrite(pktbuf, 1, pkt_len, capture->file) != pkt_len)
+        goto fail;
+    }
+  }
+
+  len = _uvc_capture_padding(len);
+  if (len && fwrite(zeros, 1, len, capture->file) != len)
+    goto fail;
+
+  return;
+
+fail:
+  UVC_DEBUG("failed to write capture record, stopping capture");
+  capture->failed = 1;
+}
+
+/** @internal
+ * @brief Map (or on Windows, read) a capture file into memory
+ */
+static uvc_error_t _uvc_replay_load(struct uvc_replay *replay, const char *path) {
+#if _WIN32
+  FILE *file = fopen(path, "rb");
+  long len;
+
+  if (!file)
+    return UVC_ERROR_NOT_FOUND;
+
+  fseek(file, 0, SEEK_END);
+  len = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (len < 0) {
+    fclose(file);
+    return UVC_ERROR_IO;
+  }
+
+  replay->contents.resize(len);
+  if (len > 0 && fread(replay->contents.data(), 1, len, file) != (size_t) len) {
+    fclose(file);
+    return UVC_ERROR_IO;
+  }
+  fclose(file);
+
+  replay->data = replay->contents.data();
+  replay->size = len;
+#else
+  struct stat st;
+  void *map;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    return UVC_ERROR_NOT_FOUND;
+
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return UVC_ERROR_IO;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return UVC_ERROR_IO;
+
+  replay->data = (const uint8_t *) map;
+  replay->size = st.st_size;
+#endif
+
+  return UVC_SUCCESS;
+}
+
+/** @brief Open a stream that plays back a capture file
+ * @ingroup replay
+ *
+ * The returned stream behaves like one opened on the captured camera:
+ * start it with uvc_stream_start(), get frames through the callback or
+ * uvc_stream_get_frame(), read uvc_stream_get_stats(), then stop and close it
+ * with uvc_stream_stop() and uvc_stream_close(). Transfers are processed
+ * on a thread of the library's own instead of the libusb event thread.
+ *
+ * @param path Capture written by uvc_stream_start_capture()
+ * @param flags Any of enum uvc_replay_flags
+ * @param[out] strmhp Replay stream
+ * @return UVC_ERROR_NOT_FOUND if the file can't be opened,
+ * UVC_ERROR_NOT_SUPPORTED if it is not a capture this version understands
+ */
+uvc_error_t uvc_stream_open_replay(const char *path, uint8_t flags, uvc_stream_handle_t **strmhp) {
+  const struct uvc_capture_file_header *header;
+  struct uvc_replay *replay;
+  uvc_stream_handle_t *strmh;
+  uvc_error_t ret;
+
+  UVC_ENTER();
+
+  replay = new uvc_replay();
+  replay->flags = flags;
+
+  ret = _uvc_replay_load(replay, path);
+  if (ret != UVC_SUCCESS)
+    goto fail;
+
+  header = (const struct uvc_capture_file_header *) replay->data;
+  if (replay->size < sizeof(*header) ||
+      memcmp(header->magic, UVC_CAPTURE_MAGIC, sizeof(header->magic)) ||
+      header->version != UVC_CAPTURE_VERSION ||
+      header->header_bytes < sizeof(*header) || header->header_bytes > replay->size) {
+    ret = UVC_ERROR_NOT_SUPPORTED;
+    goto fail;
+  }
+
+  /* A device with a single format and frame size, as negotiated when the
+   * capture was made */
+  replay->devh.info = new uvc_device_info_t();
+  replay->devh.is_isight = header->is_isight;
+  replay->stream_if.bInterfaceNumber = 1;
+  replay->format_desc.parent = &replay->stream_if;
+  replay->format_desc.bDescriptorSubtype = (enum uvc_vs_desc_subtype) header->bDescriptorSubtype;
+  replay->format_desc.bFormatIndex = 1;
+  replay->format_desc.bNumFrameDescriptors = 1;
+  replay->format_desc.bDefaultFrameIndex = 1;
+  memcpy(replay->format_desc.guidFormat, header->guidFormat, sizeof(header->guidFormat));
+  replay->frame_desc.parent = &replay->format_desc;
+  replay->frame_desc.bFrameIndex = 1;
+  replay->frame_desc.wWidth = header->wWidth;
+  replay->frame_desc.wHeight = header->wHeight;
+  replay->frame_desc.dwDefaultFrameInterval = header->dwFrameInterval;
+  replay->frame_desc.dwMaxVideoFrameBufferSize = header->dwMaxVideoFrameSize;
+  DL_APPEND(replay->format_desc.frame_descs, &replay->frame_desc);
+  DL_APPEND(replay->stream_if.format_descs, &replay->format_desc);
+  DL_APPEND(replay->devh.info->stream_ifs, &replay->stream_if);
+
+  replay->transfer_buf = (uint8_t *) malloc(header->dwMaxPayloadTransferSize);
+  if (!replay->transfer_buf) {
+    ret = UVC_ERROR_NO_MEM;
+    goto fail;
+  }
+
+  strmh = new uvc_stream_handle_t();
+  strmh->devh = &replay->devh;
+  strmh->stream_if = &replay->stream_if;
+  strmh->frame.library_owns_data = 1;
+  strmh->cur_ctrl.bFormatIndex = 1;
+  strmh->cur_ctrl.bFrameIndex = 1;
+  strmh->cur_ctrl.dwFrameInterval = header->dwFrameInterval;
+  strmh->cur_ctrl.dwMaxVideoFrameSize = header->dwMaxVideoFrameSize;
+  strmh->cur_ctrl.dwMaxPayloadTransferSize = header->dwMaxPayloadTransferSize;
+  strmh->cur_ctrl.bInterfaceNumber = replay->stream_if.bInterfaceNumber;
+  strmh->replay = replay;
+  DL_APPEND(replay->devh.streams, strmh);
+
+  *strmhp = strmh;
+
+  UVC_EXIT(UVC_SUCCESS);
+  return UVC_SUCCESS;
+
+fail:
+  delete replay;
+  UVC_EXIT(ret);
+  return ret;
+}
+
+/** @internal
+ * @brief Feed one recorded transfer into the stream
+ *
+ * Mirrors _uvc_stream_callback, minus resubmission. The payload of a bulk
+ * transfer is first copied to a transfer buffer, as the USB stack would have
+ * done, so that it may be swapped into the frame buffer pool.
+ */
+static void _uvc_replay_transfer(uvc_stream_handle_t *strmh, const struct uvc_capture_record *record) {
+  struct uvc_replay *replay = strmh->replay;
+  const struct uvc_capture_iso_packet *pkts =
+    (const struct uvc_capture_iso_packet *) (record + 1);
+  uint8_t *data = (uint8_t *) (pkts + record->num_iso_packets);
+  uint32_t i;
+
+  if (record->status != LIBUSB_TRANSFER_COMPLETED) {
+    if (record->status != LIBUSB_TRANSFER_CANCELLED)
+      _uvc_count(&strmh->counters.transfer_errors);
+    return;
+  }
+
+  if (record->num_iso_packets == 0) {
+    struct libusb_transfer transfer;
+    size_t len = std::min<size_t>(record->data_bytes, strmh->cur_ctrl.dwMaxPayloadTransferSize);
+
+    memset(&transfer, 0, sizeof(transfer));
+    transfer.buffer = replay->transfer_buf;
+    transfer.length = strmh->cur_ctrl.dwMaxPayloadTransferSize;
+    transfer.actual_length = len;
+    transfer.status = LIBUSB_TRANSFER_COMPLETED;
+    memcpy(transfer.buffer, data, len);
+
+    _uvc_process_bulk_transfer(strmh, &transfer);
+    replay->transfer_buf = transfer.buffer;
+  } else {
+    /* The payload path only reads packets, so they are used in place */
+    for (i = 0; i < record->num_iso_packets; ++i) {
+      if (pkts[i].status != 0) {
+        UVC_DEBUG("bad packet (isochronous transfer); status: %d", pkts[i].status);
+        _uvc_count(&strmh->counters.iso_packet_errors);
+      } else {
+        _uvc_process_payload(strmh, data, pkts[i].actual_length);
+      }
+      data += pkts[i].actual_length;
+    }
+  }
+}
+
+/** @internal
+ * @brief Replay thread: walk the capture's records until the end of the file
+ * (or forever if looping) or until the stream is stopped
+ */
+static void _uvc_replay_run(uvc_stream_handle_t *strmh) {
+  struct uvc_replay *replay = strmh->replay;
+  const struct uvc_capture_file_header *header =
+    (const struct uvc_capture_file_header *) replay->data;
+  auto start_time = std::chrono::steady_clock::now();
+
+  do {
+    size_t offset = header->header_bytes;
+    uint64_t last_ns = 0;
+
+    while (strmh->running && offset + sizeof(struct uvc_capture_record) <= replay->size) {
+      const struct uvc_capture_record *record =
+        (const struct uvc_capture_record *) (replay->data + offset);
+      size_t used = sizeof(*record) +
+        (size_t) record->num_iso_packets * sizeof(struct uvc_capture_iso_packet) +
+        record->data_bytes;
+
+      if (record->record_bytes < used || offset + record->record_bytes > replay->size) {
+        UVC_DEBUG("truncated capture record at offset %zu", offset);
+        break;
+      }
+
+      if (replay->flags & UVC_REPLAY_FLAG_REALTIME)
+        std::this_thread::sleep_until(start_time + std::chrono::nanoseconds(record->timestamp_ns));
+
+      _uvc_replay_transfer(strmh, record);
+
+      last_ns = record->timestamp_ns;
+      offset += record->record_bytes;
+    }
+
+    /* the next pass starts where this one ended */
+    start_time += std::chrono::nanoseconds(last_ns);
+  } while (strmh->running && (replay->flags & UVC_REPLAY_FLAG_LOOP));
+}
+
+/** @internal
+ * @brief Start feeding the capture into a replay stream
+ */
+uvc_error_t _uvc_replay_start(uvc_stream_handle_t *strmh) {
+  strmh->replay->thread = std::thread(_uvc_replay_run, strmh);
+  return UVC_SUCCESS;
+}
+
+/** @internal
+ * @brief Wait for the replay thread after the stream is marked not running
+ */
+void _uvc_replay_stop(uvc_stream_handle_t *strmh) {
+  if (strmh->replay->thread.joinable())
+    strmh->replay->thread.join();
+}
+
+/** @internal
+ * @brief Free a replay stream along with its stand-in device
+ */
+void _uvc_replay_close(uvc_stream_handle_t *strmh) {
+  struct uvc_replay *replay = strmh->replay;
+
+  if (strmh->frame.data)
+    _uvc_frame_data_free(strmh->frame.data);
+  if (strmh->frame.metadata)
+    free(strmh->frame.metadata);
+  free(strmh->frame.nal_units);
+
+  DL_DELETE(replay->devh.streams, strmh);
+  delete strmh;
+  delete replay;
+}
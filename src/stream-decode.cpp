@@ -0,0 +1,313 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (C) 2010-2012 Ken Tossell
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the author nor other contributors may be
+*     used to endorse or promote products derived from this software
+*     without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+/**
+ * @internal
+ * @file stream-decode.cpp
+ * @brief Decode stage that turns a stream's MJPEG frames into images on
+ * worker threads
+ */
+#include "libuvc/libuvc.h"
+#include "libuvc/libuvc_internal.h"
+
+#include <deque>
+#include <system_error>
+
+/** Workers decoding a stream's frames, delivering them in capture order
+ *
+ * The callback thread queues each ready frame buffer. A worker takes the
+ * oldest one along with the next ticket, decodes it into its own output
+ * frame and returns the buffer to the stream's free list. It then waits
+ * until every older ticket has been delivered and calls the user callback
+ * itself, so callbacks come from the workers, one at a time and in order.
+ */
+struct uvc_decode_stage {
+  uvc_stream_handle_t *strmh;
+  enum uvc_frame_format format;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  /** Workers wait here for frames to decode */
+  std::condition_variable work_cond;
+  /** Workers wait here for their turn to deliver */
+  std::condition_variable turn_cond;
+  std::deque<struct uvc_frame_buffer *> queue;
+  /** Ticket of the next frame taken from the queue */
+  uint64_t next_ticket;
+  /** Ticket of the next frame to be delivered */
+  uint64_t next_delivery;
+  bool stop;
+
+  uvc_decode_stage()
+    : strmh(nullptr)
+    , format(UVC_FRAME_FORMAT_UNKNOWN)
+    , next_ticket(0)
+    , next_delivery(0)
+    , stop(false) {
+  }
+};
+
+/** @internal
+ * @brief Copy a frame buffer's header metadata to a decoded frame
+ *
+ * A worker reuses its decoded frame, so a frame whose metadata is missing
+ * or cannot be copied gets none rather than an earlier frame's.
+ */
+static void decode_copy_metadata(struct uvc_frame_buffer *fb, uvc_frame_t *out) {
+  size_t sz = fb->meta_got_bytes;
+
+  if (sz == 0) {
+    out->metadata_bytes = 0;
+    return;
+  }
+
+  if (out->metadata_bytes < sz) {
+    void *metadata = realloc(out->metadata, sz);
+
+    if (!metadata) {
+      out->metadata_bytes = 0;
+      return;
+    }
+    out->metadata = metadata;
+  }
+  out->metadata_bytes = sz;
+  memcpy(out->metadata, fb->meta_buf, sz);
+}
+
+/** @internal
+ * @brief Decode queued frames until the stage stops
+ *
+ * Owns @p decoder and @p out, its reused output frame, and frees both.
+ */
+static void decode_worker(struct uvc_decode_stage *stage, uvc_mjpeg_decoder_t *decoder,
+    uvc_frame_t *out) {
+  uvc_stream_handle_t *strmh = stage->strmh;
+  std::unique_lock<std::mutex> lock(stage->mutex);
+
+  for (;;) {
+    struct uvc_frame_buffer *fb;
+    uint64_t ticket;
+    uvc_frame_t in;
+    uvc_error_t ret;
+
+    stage->work_cond.wait(lock, [&]{return stage->stop || !stage->queue.empty();});
+    if (stage->stop)
+      break;
+
+    fb = stage->queue.front();
+    stage->queue.pop_front();
+    ticket = stage->next_ticket++;
+    lock.unlock();
+
+    /* Decode straight out of the stream's buffer, then give it back */
+    _uvc_populate_frame_info(strmh, fb, &in);
+    in.data = fb->buf + fb->data_offset;
+    in.data_bytes = fb->got_bytes;
+
+    /* A DROP_CORRUPT stream checked the frame as it completed */
+    if (!(strmh->flags & UVC_STREAM_FLAG_DROP_CORRUPT) &&
+        !_uvc_mjpeg_valid((const uint8_t *) in.data, in.data_bytes))
+      ret = UVC_ERROR_OTHER;
+    else
+      ret = uvc_mjpeg_decode(decoder, &in, out, stage->format);
+    if (ret == UVC_SUCCESS)
+      decode_copy_metadata(fb, out);
+    strmh->free_bufs.push(fb);
+
+    lock.lock();
+    stage->turn_cond.wait(lock, [&]{return stage->next_delivery == ticket;});
+
+    if (ret != UVC_SUCCESS) {
+      _uvc_count(&strmh->counters.decode_errors);
+    } else if (!stage->stop) {
+      /* Later tickets wait for this one, so the callback runs unlocked */
+      lock.unlock();
+      _uvc_count(&strmh->counters.frames_delivered);
+      _uvc_record_latency(strmh->counters.callback_latency_hist,
+                          std::chrono::steady_clock::now() - out->capture_time_finished);
+      strmh->user_cb(out, strmh->user_ptr);
+      lock.lock();
+    }
+
+    stage->next_delivery++;
+    stage->turn_cond.notify_all();
+  }
+
+  lock.unlock();
+  uvc_free_frame(out);
+  uvc_mjpeg_decoder_destroy(decoder);
+}
+
+/** @internal
+ * @brief Start the stream's decode stage, if uvc_stream_set_decode() enabled it
+ */
+uvc_error_t _uvc_decode_start(uvc_stream_handle_t *strmh) {
+  struct uvc_decode_stage *stage;
+
+  if (strmh->decode_format == UVC_FRAME_FORMAT_UNKNOWN)
+    return UVC_SUCCESS;
+
+  if (strmh->frame_format != UVC_FRAME_FORMAT_MJPEG)
+    return UVC_ERROR_NOT_SUPPORTED;
+
+  stage = new uvc_decode_stage();
+  stage->strmh = strmh;
+  stage->format = strmh->decode_format;
+  strmh->decode = stage;
+
+  for (int i = 0; i < strmh->decode_threads; ++i) {
+    uvc_mjpeg_decoder_t *decoder;
+    uvc_frame_t *out;
+
+    if (uvc_mjpeg_decoder_create(&decoder) != UVC_SUCCESS) {
+      _uvc_decode_stop(strmh);
+      return UVC_ERROR_NO_MEM;
+    }
+
+    out = uvc_allocate_frame(0);
+    if (!out) {
+      uvc_mjpeg_decoder_destroy(decoder);
+      _uvc_decode_stop(strmh);
+      return UVC_ERROR_NO_MEM;
+    }
+
+    try {
+      stage->workers.emplace_back(decode_worker, stage, decoder, out);
+    } catch (const std::system_error &) {
+      uvc_free_frame(out);
+      uvc_mjpeg_decoder_destroy(decoder);
+      _uvc_decode_stop(strmh);
+      return UVC_ERROR_NO_MEM;
+    }
+  }
+
+  return UVC_SUCCESS;
+}
+
+/** @internal
+ * @brief Queue a ready frame buffer for decoding
+ *
+ * Called by the callback thread. The buffer goes back to the free list
+ * once it has been decoded.
+ */
+void _uvc_decode_submit(uvc_stream_handle_t *strmh, struct uvc_frame_buffer *fb) {
+  struct uvc_decode_stage *stage = strmh->decode;
+
+  {
+    std::lock_guard<std::mutex> lock(stage->mutex);
+    stage->queue.push_back(fb);
+  }
+  stage->work_cond.notify_one();
+}
+
+/** @internal
+ * @brief Stop the stream's decode stage and wait for its workers
+ *
+ * Frames still queued are returned undecoded; a frame being decoded is
+ * finished but not delivered.
+ */
+void _uvc_decode_stop(uvc_stream_handle_t *strmh) {
+  struct uvc_decode_stage *stage = strmh->decode;
+
+  if (!stage)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(stage->mutex);
+
+    stage->stop = true;
+    for (struct uvc_frame_buffer *fb : stage->queue)
+      strmh->free_bufs.push(fb);
+    stage->queue.clear();
+  }
+  stage->work_cond.notify_all();
+  stage->turn_cond.notify_all();
+
+  for (auto &worker : stage->workers)
+    worker.join();
+
+  strmh->decode = NULL;
+  delete stage;
+}
+
+/** @brief Decode a stream's MJPEG frames on worker threads
+ * @ingroup streaming
+ *
+ * Once enabled, uvc_stream_start() starts @p num_threads workers beside
+ * the callback thread. Each frame is decoded straight from the stream's
+ * buffer by whichever worker is free, and the decoded images reach the
+ * callback in capture order. The transfer and callback threads are left
+ * free, so MJPEG streams whose decode time exceeds the frame interval keep
+ * up by using several cores.
+ *
+ * The callback is called from the worker threads, never two at once. The
+ * frame passed to it is valid until the callback returns. Frames that
+ * fail uvc_mjpeg_validate() or fail to decode are counted in
+ * uvc_stream_stats::decode_errors and skipped. UVC_STREAM_FLAG_ZERO_COPY has no effect on a decoding stream,
+ * which requires a callback.
+ *
+ * The stream gets at least @p num_threads + 2 frame buffers so every
+ * worker can hold one.
+ *
+ * @param strmh UVC stream, opened but not running
+ * @param format UVC_FRAME_FORMAT_RGB, UVC_FRAME_FORMAT_GRAY8,
+ *   UVC_FRAME_FORMAT_I420 or UVC_FRAME_FORMAT_NV12; UVC_FRAME_FORMAT_UNKNOWN
+ *   delivers the compressed frames again
+ * @param num_threads Worker threads; 0 for one per hardware thread
+ * @return UVC_ERROR_BUSY if the stream is running
+ */
+uvc_error_t uvc_stream_set_decode(uvc_stream_handle_t *strmh,
+    enum uvc_frame_format format, int num_threads) {
+  if (strmh->running)
+    return UVC_ERROR_BUSY;
+
+  switch (format) {
+  case UVC_FRAME_FORMAT_UNKNOWN:
+  case UVC_FRAME_FORMAT_RGB:
+  case UVC_FRAME_FORMAT_GRAY8:
+  case UVC_FRAME_FORMAT_I420:
+  case UVC_FRAME_FORMAT_NV12:
+    break;
+  default:
+    return UVC_ERROR_NOT_SUPPORTED;
+  }
+
+  if (num_threads < 0)
+    return UVC_ERROR_INVALID_PARAM;
+
+  if (num_threads == 0)
+    num_threads = std::max(1, (int) std::thread::hardware_concurrency());
+
+  strmh->decode_format = format;
+  strmh->decode_threads = num_threads;
+  return UVC_SUCCESS;
+}
@@ -47,8 +47,9 @@ uvc_frame_desc_t *uvc_find_frame_desc_stream(uvc_stream_handle_t *strmh,
     uint16_t format_id, uint16_t frame_id);
 uvc_frame_desc_t *uvc_find_frame_desc(uvc_device_handle_t *devh,
     uint16_t format_id, uint16_t frame_id);
-void *_uvc_user_caller(void *arg);
-void _uvc_populate_frame(uvc_stream_handle_t *strmh);
+void _uvc_populate_frame(uvc_stream_handle_t *strmh, struct uvc_frame_buffer *fb);
+uvc_frame_t *_uvc_lend_frame(uvc_stream_handle_t *strmh, struct uvc_frame_buffer *fb);
+static uvc_frame_t *_uvc_frame_view(uvc_stream_handle_t *strmh, struct uvc_frame_buffer *fb);
 
 static uvc_streaming_interface_t *_uvc_get_stream_if(uvc_device_handle_t *devh, int interface_idx);
 static uvc_stream_handle_t *_uvc_get_stream_by_interface(uvc_device_handle_t *devh, int interface_idx);
@@ -80,9 +81,10 @@ struct format_table_entry *_get_format_entry(enum uvc_frame_format format) {
     ABS_FMT(UVC_FRAME_FORMAT_ANY, 2,
       {UVC_FRAME_FORMAT_UNCOMPRESSED, UVC_FRAME_FORMAT_COMPRESSED})
 
-    ABS_FMT(UVC_FRAME_FORMAT_UNCOMPRESSED, 6,
+    ABS_FMT(UVC_FRAME_FORMAT_UNCOMPRESSED, 7,
       {UVC_FRAME_FORMAT_YUYV, UVC_FRAME_FORMAT_UYVY, UVC_FRAME_FORMAT_GRAY8,
-      UVC_FRAME_FORMAT_GRAY16, UVC_FRAME_FORMAT_NV12, UVC_FRAME_FORMAT_BGR})
+      UVC_FRAME_FORMAT_GRAY16, UVC_FRAME_FORMAT_NV12, UVC_FRAME_FORMAT_I420,
+      UVC_FRAME_FORMAT_BGR})
     FMT(UVC_FRAME_FORMAT_YUYV,
       {'Y',  'U',  'Y',  '2', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71})
     FMT(UVC_FRAME_FORMAT_UYVY,
@@ -93,6 +95,8 @@ struct format_table_entry *_get_format_entry(enum uvc_frame_format format) {
       {'Y',  '1',  '6',  ' ', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71})
     FMT(UVC_FRAME_FORMAT_NV12,
       {'N',  'V',  '1',  '2', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71})
+    FMT(UVC_FRAME_FORMAT_I420,
+      {'I',  '4',  '2',  '0', 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71})
     FMT(UVC_FRAME_FORMAT_BGR,
       {0x7d, 0xeb, 0x36, 0xe4, 0x4f, 0x52, 0xce, 0x11, 0x9f, 0x53, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70})
     FMT(UVC_FRAME_FORMAT_BY8,
@@ -616,41 +620,206 @@ uvc_error_t uvc_probe_still_ctrl(
 }
 
 /** @internal
- * @brief Swap the working buffer with the presented buffer and notify consumers
+ * @brief Add a latency sample to a base-2 histogram (see uvc_stream_stats)
  */
-void _uvc_swap_buffers(uvc_stream_handle_t *strmh) {
-  {
-    std::lock_guard<std::mutex> lock(strmh->callback_mutex);
-    strmh->capture_time_finished = std::chrono::steady_clock::now();
+void _uvc_record_latency(std::atomic<uint64_t> *hist, std::chrono::steady_clock::duration d) {
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  int bucket = 0;
 
-    // std::swap does not perform memcpy's; it just swaps the underlying
-    // pointers
+  while (us > 0 && bucket < UVC_STREAM_STATS_HISTOGRAM_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  _uvc_count(&hist[bucket]);
+}
 
-    /* swap the buffers */
-    std::swap(strmh->outbuf, strmh->holdbuf);
-    strmh->hold_last_scr = strmh->last_scr;
-    strmh->hold_pts = strmh->pts;
-    strmh->hold_seq = strmh->seq;
-  
-    /* swap metadata buffer */
-    std::swap(strmh->meta_outbuf, strmh->meta_holdbuf);
+/** @internal
+ * @brief Whether a stream indexes the NAL units of its frames
+ */
+static inline int _uvc_h264_indexing(uvc_stream_handle_t *strmh) {
+  return (strmh->flags & UVC_STREAM_FLAG_H264_INDEX) &&
+         strmh->frame_format == UVC_FRAME_FORMAT_H264;
+}
+
+/** @internal
+ * @brief Index the H.264 NAL units appended to a frame buffer since the last call
+ *
+ * Finds the Annex B start codes in the new bytes while they are still in
+ * cache. A start code whose NAL header byte has not arrived yet is looked
+ * at again on the next call. With @p finish set the frame is complete and
+ * the last unit's size is settled.
+ */
+static void _uvc_h264_scan(struct uvc_frame_buffer *fb, int finish) {
+  const uint8_t *p = fb->buf + fb->data_offset;
+  size_t end = fb->got_bytes;
+  size_t pos = std::max(fb->nal_scan_pos, (size_t) 2);
+
+  /* Look for the 01 of each 00 00 01 that has a byte after it */
+  while (pos + 1 < end) {
+    const uint8_t *one = (const uint8_t *) memchr(p + pos, 1, end - 1 - pos);
+
+    if (!one) {
+      pos = end - 1;
+      break;
+    }
+    pos = one - p;
+
+    if (p[pos - 1] == 0 && p[pos - 2] == 0) {
+      /* A 4-byte start code's leading zero belongs to neither unit */
+      size_t start = pos > 2 && p[pos - 3] == 0 ? pos - 3 : pos - 2;
+      uvc_nal_unit_t nal;
+
+      if (!fb->nal_units.empty())
+        fb->nal_units.back().size = start - fb->nal_units.back().offset;
+
+      nal.offset = pos + 1;
+      nal.size = 0;
+      nal.type = p[pos + 1] & 0x1f;
+      if (nal.type == 5)
+        fb->key_frame = 1;
+      fb->nal_units.push_back(nal);
+    }
+    ++pos;
   }
-  strmh->callback_cond.notify_all();
+  fb->nal_scan_pos = pos;
+
+  if (finish && !fb->nal_units.empty())
+    fb->nal_units.back().size = end - fb->nal_units.back().offset;
+}
 
-  // Clear the buffers used to accumulate the next frame. We want the size
-  // to be 0 but the capacity to remain the same, however the C++ standard
-  // doesn't guarantee the capacity won't change. Do a reserve() to
-  // ensure the buffer is the size we need. Hopefully it's just a noop on
-  // your compiler.
-  strmh->outbuf.clear();
-  strmh->outbuf.reserve(uvc_stream_config.size_of_transport_buffer);
-  strmh->meta_outbuf.clear();
-  strmh->meta_outbuf.reserve(uvc_stream_config.size_of_meta_transport_buffer);
+/** @internal
+ * @brief Pass the slices of cur_buf that have arrived to the slice callback
+ *
+ * Hands over every whole slice not yet seen in one call, or with
+ * @p finish set, everything up to the end of the frame.
+ */
+static void _uvc_deliver_slices(uvc_stream_handle_t *strmh, int finish) {
+  struct uvc_frame_buffer *fb = strmh->cur_buf;
+  size_t end = fb->got_bytes;
+  uvc_frame_t *frame;
+
+  if (!finish)
+    end -= end % strmh->slice_bytes;
+  if (end <= strmh->slice_done)
+    return;
+
+  frame = _uvc_frame_view(strmh, fb);
+  frame->data_bytes = end;
+  frame->sequence = strmh->seq;
+  frame->capture_time_finished = std::chrono::steady_clock::time_point();
+
+  strmh->slice_cb(frame, strmh->slice_done, strmh->slice_user_ptr);
+  strmh->slice_done = end;
+}
+
+/** @internal
+ * @brief Publish the working buffer and notify consumers
+ *
+ * Queues the frame assembled in cur_buf and takes a free slot to assemble
+ * the next one. If every slot is queued or lent out, the finished frame is
+ * dropped and its slot reused, as is a frame missing a payload that could
+ * not be stored, and a corrupt MJPEG frame when the stream was started
+ * with UVC_STREAM_FLAG_DROP_CORRUPT. With
+ * UVC_STREAM_FLAG_INLINE_CALLBACK the frame goes to the user's callback
+ * right here instead, and cur_buf assembles the next frame once it returns.
+ */
+void _uvc_swap_buffers(uvc_stream_handle_t *strmh) {
+  struct uvc_frame_buffer *fb = strmh->cur_buf;
+  struct uvc_frame_buffer *next_fb;
+
+  auto now = std::chrono::steady_clock::now();
+
+  _uvc_count(&strmh->counters.frames_completed);
+  _uvc_record_latency(strmh->counters.assembly_latency_hist, now - fb->capture_time_started);
+
+  if (_uvc_h264_indexing(strmh))
+    _uvc_h264_scan(fb, 1);
+
+  if (strmh->slice_cb && !fb->incomplete)
+    _uvc_deliver_slices(strmh, 1);
+
+  fb->capture_time_finished = now;
+  fb->last_scr = strmh->last_scr;
+  fb->pts = strmh->pts;
+  fb->seq = strmh->seq;
+
+  if (fb->incomplete) {
+    UVC_DEBUG("frame %u is missing data, dropping", strmh->seq);
+    _uvc_count(&strmh->counters.incomplete_frames);
+  } else if ((strmh->flags & UVC_STREAM_FLAG_DROP_CORRUPT) &&
+      strmh->frame_format == UVC_FRAME_FORMAT_MJPEG &&
+      !_uvc_mjpeg_valid(fb->buf + fb->data_offset, fb->got_bytes)) {
+    UVC_DEBUG("corrupt MJPEG frame %u, dropping", strmh->seq);
+    _uvc_count(&strmh->counters.corrupt_frames);
+  } else if (strmh->flags & UVC_STREAM_FLAG_INLINE_CALLBACK) {
+    _uvc_count(&strmh->counters.frames_delivered);
+    _uvc_record_latency(strmh->counters.callback_latency_hist,
+                        std::chrono::steady_clock::now() - now);
+    strmh->user_cb(_uvc_frame_view(strmh, fb), strmh->user_ptr);
+  } else if (strmh->free_bufs.pop(&next_fb)) {
+    strmh->ready_bufs.push(fb);
+    strmh->cur_buf = next_fb;
+
+    // Pairs with the fence in _uvc_wait_for_frame: either the consumer sees
+    // the frame we just pushed, or we see that it is (about to be) asleep.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (strmh->frame_waiters.load(std::memory_order_relaxed)) {
+      {
+        // Taking the lock ensures a consumer that registered as a waiter
+        // has actually started waiting, so the notification can't be lost.
+        std::lock_guard<std::mutex> lock(strmh->callback_mutex);
+      }
+      strmh->callback_cond.notify_all();
+    }
+  } else {
+    UVC_DEBUG("no free frame buffer, dropping frame %u", strmh->seq);
+    _uvc_count(&strmh->counters.frames_dropped);
+  }
+
+  // Rewind the write cursors; the slot's storage is reused as is.
+  strmh->cur_buf->data_offset = 0;
+  strmh->cur_buf->got_bytes = 0;
+  strmh->cur_buf->meta_got_bytes = 0;
+  strmh->cur_buf->nal_units.clear();
+  strmh->cur_buf->nal_scan_pos = 0;
+  strmh->cur_buf->key_frame = 0;
+  strmh->cur_buf->incomplete = 0;
+  strmh->slice_done = 0;
   strmh->seq++;
   strmh->last_scr = 0;
   strmh->pts = 0;
 }
 
+/** @internal
+ * @brief Append a run of bytes to a frame buffer at its write cursor
+ *
+ * The buffer is normally sized for the largest frame the device negotiated,
+ * so this is a single memcpy. It only grows if the device sends more than
+ * it promised.
+ *
+ * @return 0, or -1 if the buffer could not grow and the bytes were dropped
+ */
+static inline int _uvc_append_bytes(uint8_t **buf, size_t *buf_size, size_t *cursor,
+    const uint8_t *src, size_t len) {
+  size_t end = *cursor + len;
+
+  if (end > *buf_size) {
+    size_t new_size = std::max(end, *buf_size * 2);
+    uint8_t *new_buf = (uint8_t *) realloc(*buf, new_size);
+
+    if (!new_buf) {
+      UVC_DEBUG("out of memory growing frame buffer to %zu bytes", new_size);
+      return -1;
+    }
+    *buf = new_buf;
+    *buf_size = new_size;
+  }
+
+  memcpy(*buf + *cursor, src, len);
+  *cursor = end;
+  return 0;
+}
+
 /** @internal
  * @brief Process a payload transfer
  * 
@@ -660,8 +829,11 @@ void _uvc_swap_buffers(uvc_stream_handle_t *strmh) {
  * @param payload Contents of the payload transfer, either a packet (isochronous) or a full
  * transfer (bulk mode)
  * @param payload_len Length of the payload transfer
+ * @param bulk_transfer Bulk transfer that payload is the buffer of, or NULL. If
+ * it holds a whole frame, its buffer is taken as the frame instead of copied
  */
-void _uvc_process_payload(uvc_stream_handle_t *strmh, uint8_t *payload, size_t payload_len) {
+static void _uvc_handle_payload(uvc_stream_handle_t *strmh, uint8_t *payload, size_t payload_len,
+    struct libusb_transfer *bulk_transfer) {
   size_t header_len;
   uint8_t header_info;
   size_t data_len;
@@ -695,6 +867,7 @@ void _uvc_process_payload(uvc_stream_handle_t *strmh, uint8_t *payload, size_t p
 
     if (header_len > payload_len) {
       UVC_DEBUG("bogus packet: actual_len=%zd, header_len=%zd\n", payload_len, header_len);
+      _uvc_count(&strmh->counters.bogus_header_packets);
       return;
     }
 
@@ -714,13 +887,16 @@ void _uvc_process_payload(uvc_stream_handle_t *strmh, uint8_t *payload, size_t p
 
     if (header_info & 0x40) {
       UVC_DEBUG("bad packet: error bit set");
+      _uvc_count(&strmh->counters.error_packets);
       return;
     }
 
-    if (strmh->fid != (header_info & 1) && !strmh->outbuf.empty()) {
+    if (strmh->fid != (header_info & 1) &&
+        (strmh->cur_buf->got_bytes != 0 || strmh->cur_buf->incomplete)) {
       /* The frame ID bit was flipped, but we have image data sitting
          around from prior transfers. This means the camera didn't send
          an EOF for the last transfer of the previous frame. */
+      _uvc_count(&strmh->counters.fid_resyncs);
       _uvc_swap_buffers(strmh);
     }
 
@@ -742,14 +918,42 @@ void _uvc_process_payload(uvc_stream_handle_t *strmh, uint8_t *payload, size_t p
       // Metadata is attached to header
       size_t sz = header_len - variable_offset;
       uint8_t *src = payload + variable_offset;
-      std::copy(src, src+sz, std::back_inserter(strmh->meta_outbuf));
+      if (_uvc_append_bytes(&strmh->cur_buf->meta_buf, &strmh->cur_buf->meta_buf_size,
+                            &strmh->cur_buf->meta_got_bytes, src, sz) < 0)
+        strmh->cur_buf->incomplete = 1;
+      _uvc_count(&strmh->counters.metadata_bytes, sz);
     }
   }
 
   if (data_len > 0) {
-
+    struct uvc_frame_buffer *fb = strmh->cur_buf;
     uint8_t *src = payload + header_len;
-    std::copy(src, src+data_len, std::back_inserter(strmh->outbuf));
+
+    if (fb->got_bytes == 0)
+      fb->capture_time_started = std::chrono::steady_clock::now();
+    _uvc_count(&strmh->counters.payload_bytes, data_len);
+
+    if (bulk_transfer && (header_info & (1 << 1)) && fb->got_bytes == 0 &&
+        fb->buf_size >= (size_t) bulk_transfer->length) {
+      /* The whole frame arrived in this one transfer: keep the transfer's
+       * buffer as the frame and resubmit the transfer with the slot's empty
+       * storage, rather than copying the image out. */
+      bulk_transfer->buffer = fb->buf;
+      fb->buf = payload;
+      fb->buf_size = bulk_transfer->length;
+      fb->data_offset = header_len;
+      fb->got_bytes = data_len;
+    } else if (_uvc_append_bytes(&fb->buf, &fb->buf_size, &fb->got_bytes, src, data_len) < 0) {
+      /* Later payloads would land where this one belongs */
+      fb->incomplete = 1;
+    }
+
+    if (_uvc_h264_indexing(strmh))
+      _uvc_h264_scan(fb, 0);
+
+    /* The end of the frame goes out with the frame itself */
+    if (strmh->slice_cb && !fb->incomplete && !(header_info & (1 << 1)))
+      _uvc_deliver_slices(strmh, 0);
 
     if (header_info & (1 << 1)) {
       /* The EOF bit is set, so publish the complete frame */
@@ -758,6 +962,24 @@ void _uvc_process_payload(uvc_stream_handle_t *strmh, uint8_t *payload, size_t p
   }
 }
 
+/** @internal
+ * @brief Process a payload transfer (see _uvc_handle_payload)
+ */
+void _uvc_process_payload(uvc_stream_handle_t *strmh, uint8_t *payload, size_t payload_len) {
+  _uvc_handle_payload(strmh, payload, payload_len, NULL);
+}
+
+/** @internal
+ * @brief Process a completed bulk transfer, which carries a single payload
+ *
+ * If the payload is a complete frame, the transfer's buffer is swapped into
+ * the frame buffer pool and transfer->buffer replaced, so the image is never
+ * copied. Otherwise it is assembled like any other payload.
+ */
+void _uvc_process_bulk_transfer(uvc_stream_handle_t *strmh, struct libusb_transfer *transfer) {
+  _uvc_handle_payload(strmh, transfer->buffer, transfer->actual_length, transfer);
+}
+
 /** @internal
  * @brief Stream transfer callback
  *
@@ -771,11 +993,14 @@ void LIBUSB_CALL _uvc_stream_callback(struct libusb_transfer *transfer) {
 
   int resubmit = 1;
 
+  if (strmh->capture)
+    _uvc_capture_transfer(strmh->capture, transfer);
+
   switch (transfer->status) {
   case LIBUSB_TRANSFER_COMPLETED:
     if (transfer->num_iso_packets == 0) {
       /* This is a bulk mode transfer, so it just has one payload transfer */
-      _uvc_process_payload(strmh, transfer->buffer, transfer->actual_length);
+      _uvc_process_bulk_transfer(strmh, transfer);
     } else {
       /* This is an isochronous mode transfer, so each packet has a payload transfer */
       int packet_id;
@@ -788,6 +1013,7 @@ void LIBUSB_CALL _uvc_stream_callback(struct libusb_transfer *transfer) {
 
         if (pkt->status != 0) {
           UVC_DEBUG("bad packet (isochronous transfer); status: %d", pkt->status);
+          _uvc_count(&strmh->counters.iso_packet_errors);
           continue;
         }
 
@@ -802,6 +1028,8 @@ void LIBUSB_CALL _uvc_stream_callback(struct libusb_transfer *transfer) {
   case LIBUSB_TRANSFER_ERROR:
   case LIBUSB_TRANSFER_NO_DEVICE:
     UVC_DEBUG("not retrying transfer, status = %d", transfer->status);
+    if (transfer->status != LIBUSB_TRANSFER_CANCELLED)
+      _uvc_count(&strmh->counters.transfer_errors);
     {
       std::lock_guard<std::mutex> lock(strmh->callback_mutex);
 
@@ -831,6 +1059,7 @@ void LIBUSB_CALL _uvc_stream_callback(struct libusb_transfer *transfer) {
   case LIBUSB_TRANSFER_STALL:
   case LIBUSB_TRANSFER_OVERFLOW:
     UVC_DEBUG("retrying transfer, status = %d", transfer->status);
+    _uvc_count(&strmh->counters.transfer_errors);
     break;
   }
   
@@ -839,6 +1068,7 @@ void LIBUSB_CALL _uvc_stream_callback(struct libusb_transfer *transfer) {
       int libusbRet = libusb_submit_transfer(transfer);
       if (libusbRet < 0)
       {
+        _uvc_count(&strmh->counters.resubmit_failures);
         {
           std::lock_guard<std::mutex> lock(strmh->callback_mutex);
 
@@ -896,8 +1126,8 @@ void LIBUSB_CALL _uvc_stream_callback(struct libusb_transfer *transfer) {
  * @param ctrl Control block, processed using {uvc_probe_stream_ctrl} or
  *             {uvc_get_stream_ctrl_format_size}
  * @param cb   User callback function. See {uvc_frame_callback_t} for restrictions.
- * @param flags Stream setup flags, currently undefined. Set this to zero. The lower bit
- * is reserved for backward compatibility.
+ * @param flags Stream setup flags, see {uvc_stream_flags}. The lower bit is reserved
+ * for backward compatibility.
  */
 uvc_error_t uvc_start_streaming(
     uvc_device_handle_t *devh,
@@ -969,7 +1199,8 @@ static uvc_streaming_interface_t *_uvc_get_stream_if(uvc_device_handle_t *devh,
 struct uvc_stream_config_t uvc_stream_config = {
   20, // number_of_transport_buffers
   8 * 1024 * 1024, // size_of_transport_buffer
-  4 * 1024 // size_of_meta_transport_buffer
+  4 * 1024, // size_of_meta_transport_buffer
+  4 // number_of_frame_buffers
 };
 
 void uvc_stream_set_default_number_of_transport_buffers(size_t s) {
@@ -981,6 +1212,70 @@ void uvc_stream_set_default_size_of_transport_buffer(size_t s) {
 void uvc_stream_set_default_size_of_meta_transport_buffer(size_t s) {
   uvc_stream_config.size_of_meta_transport_buffer = s;
 }
+/** Set the number of frame buffers given to streams started from now on.
+ * One buffer is always being filled; the others let a slow consumer fall
+ * that many frames behind before frames are dropped. At least 2.
+ */
+void uvc_stream_set_default_number_of_frame_buffers(size_t s) {
+  uvc_stream_config.number_of_frame_buffers = s < 2 ? 2 : s;
+}
+
+/** @internal
+ * @brief (Re)allocate the stream's frame buffer pool
+ *
+ * Every slot is allocated to the negotiated maximum frame size up front so
+ * the transfer callback never allocates. Slots are at least as large as a
+ * bulk transfer so their storage can be swapped with a transfer's buffer.
+ * Any frames still lent out are invalidated.
+ */
+uvc_error_t _uvc_stream_alloc_frame_buffers(uvc_stream_handle_t *strmh) {
+  size_t n = uvc_stream_config.number_of_frame_buffers;
+  size_t frame_size = std::max(strmh->cur_ctrl.dwMaxVideoFrameSize,
+                               strmh->cur_ctrl.dwMaxPayloadTransferSize);
+  size_t meta_size = uvc_stream_config.size_of_meta_transport_buffer;
+
+  if (frame_size == 0)
+    frame_size = uvc_stream_config.size_of_transport_buffer;
+
+  /* One slot being filled, one on its way to the decode stage and one
+   * held by each decode worker */
+  if (strmh->decode_format != UVC_FRAME_FORMAT_UNKNOWN)
+    n = std::max(n, (size_t) strmh->decode_threads + 2);
+
+  strmh->frame_buffers.resize(n);
+  strmh->free_bufs.reset(n);
+  strmh->ready_bufs.reset(n);
+
+  for (auto &fb : strmh->frame_buffers) {
+    if (!fb)
+      fb.reset(new uvc_frame_buffer());
+
+    if (fb->buf_size < frame_size) {
+      free(fb->buf);
+      fb->buf = (uint8_t *) malloc(frame_size);
+      fb->buf_size = fb->buf ? frame_size : 0;
+    }
+    if (fb->meta_buf_size < meta_size) {
+      free(fb->meta_buf);
+      fb->meta_buf = (uint8_t *) malloc(meta_size);
+      fb->meta_buf_size = fb->meta_buf ? meta_size : 0;
+    }
+    if (!fb->buf || !fb->meta_buf)
+      return UVC_ERROR_NO_MEM;
+
+    // Touch the pages now rather than on the first frame.
+    memset(fb->buf, 0, fb->buf_size);
+    fb->data_offset = 0;
+    fb->got_bytes = 0;
+    fb->meta_got_bytes = 0;
+    fb->incomplete = 0;
+    fb->lent.store(0);
+    strmh->free_bufs.push(fb.get());
+  }
+
+  strmh->free_bufs.pop(&strmh->cur_buf);
+  return UVC_SUCCESS;
+}
 
 /** Open a new video stream.
  * @ingroup streaming
@@ -1047,8 +1342,22 @@ fail:
  *
  * @param strmh UVC stream
  * @param cb   User callback function. See {uvc_frame_callback_t} for restrictions.
- * @param flags Stream setup flags, currently undefined. Set this to zero. The lower bit
- * is reserved for backward compatibility.
+ * @param flags Stream setup flags, see {uvc_stream_flags}. The lower bit is reserved
+ * for backward compatibility. With UVC_STREAM_FLAG_ZERO_COPY, every frame passed to
+ * the callback must be returned with uvc_stream_release_frame().
+ *
+ * With UVC_STREAM_FLAG_INLINE_CALLBACK the callback runs on the libusb event
+ * thread (a replay's own thread for replayed streams), inside the transfer
+ * completion that ended the frame, and:
+ * - the frame points at the stream's buffer and is valid only until the
+ *   callback returns. Copy or convert what is needed; the frame may be a
+ *   conversion's input but not its output, and must not be passed to
+ *   uvc_stream_release_frame().
+ * - no transfer completes while it runs, and the transfer that ended the
+ *   frame is not resubmitted until it returns, so a callback slower than a
+ *   few transfer intervals loses data.
+ * - it must not stop or close the stream, make control requests or do
+ *   anything else that waits for the event thread.
  */
 uvc_error_t uvc_stream_start(
     uvc_stream_handle_t *strmh,
@@ -1081,6 +1390,11 @@ uvc_error_t uvc_stream_start(
   strmh->fid = 0;
   strmh->pts = 0;
   strmh->last_scr = 0;
+  strmh->slice_done = 0;
+
+  ret = _uvc_stream_alloc_frame_buffers(strmh);
+  if (ret != UVC_SUCCESS)
+    goto fail;
 
   frame_desc = uvc_find_frame_desc_stream(strmh, ctrl->bFormatIndex, ctrl->bFrameIndex);
   if (!frame_desc) {
@@ -1095,6 +1409,38 @@ uvc_error_t uvc_stream_start(
     goto fail;
   }
 
+  /* The decode stage delivers to a callback and only knows MJPEG */
+  if (strmh->decode_format != UVC_FRAME_FORMAT_UNKNOWN) {
+    if (!cb) {
+      ret = UVC_ERROR_INVALID_PARAM;
+      goto fail;
+    }
+    if (strmh->frame_format != UVC_FRAME_FORMAT_MJPEG) {
+      ret = UVC_ERROR_NOT_SUPPORTED;
+      goto fail;
+    }
+  }
+
+  /* An inline callback borrows the slot being assembled, which can be
+   * neither lent out nor queued for the decode stage */
+  if ((flags & UVC_STREAM_FLAG_INLINE_CALLBACK) &&
+      (!cb || (flags & UVC_STREAM_FLAG_ZERO_COPY) ||
+       strmh->decode_format != UVC_FRAME_FORMAT_UNKNOWN)) {
+    ret = UVC_ERROR_INVALID_PARAM;
+    goto fail;
+  }
+
+#ifdef LIBUVC_HAS_JPEG
+  /* Before the USB setup, which a failure here would leave behind */
+  ret = _uvc_decode_start(strmh);
+  if (ret != UVC_SUCCESS)
+    goto fail;
+#endif
+
+  /* A replayed stream has no USB interface or transfers */
+  if (strmh->replay)
+    goto start_callback;
+
   // Get the interface that provides the chosen format and frame configuration
   interface_id = strmh->stream_if->bInterfaceNumber;
   interface = &strmh->devh->info->config->interface[interface_id];
@@ -1209,17 +1555,21 @@ uvc_error_t uvc_stream_start(
     }    
   }
 
+start_callback:
   strmh->user_cb = cb;
   strmh->user_ptr = user_ptr;
+  strmh->flags = flags;
 
   /* If the user wants it, set up a thread that calls the user's function
    * with the contents of each frame.
    */
-  if (cb) {
+  if (cb && !(flags & UVC_STREAM_FLAG_INLINE_CALLBACK)) {
     strmh->callback_thread = std::thread(_uvc_user_caller, (void*) strmh);
   }
 
-  {
+  if (strmh->replay) {
+    ret = _uvc_replay_start(strmh);
+  } else {
     auto it = std::begin(strmh->transfers);
     for ( ; it != std::end(strmh->transfers); ++it) {
       ret = libusb_submit_transfer(it->get());
@@ -1240,6 +1590,9 @@ uvc_error_t uvc_stream_start(
   UVC_EXIT(ret);
   return static_cast<uvc_error_t>(ret);
 fail:
+#ifdef LIBUVC_HAS_JPEG
+  _uvc_decode_stop(strmh);
+#endif
   strmh->running = 0;
   UVC_EXIT(ret);
   return static_cast<uvc_error_t>(ret);
@@ -1264,6 +1617,96 @@ uvc_error_t uvc_stream_start_iso(
   return uvc_stream_start(strmh, cb, user_ptr, 0);
 }
 
+/** Have a function see each frame in slices while it arrives
+ * @ingroup streaming
+ *
+ * An uncompressed 4K frame takes tens of milliseconds to cross USB. A
+ * slice callback lets line-based processing or encoding start on the
+ * first rows of a frame while the rest are still on the way, so only the
+ * last slice's work remains once the frame is complete.
+ *
+ * The callback is called whenever at least @p slice_bytes new bytes of the
+ * frame being assembled have arrived, with a multiple of @p slice_bytes of
+ * them, and once more when the frame ends with whatever is left. Passing
+ * a number of rows times the frame's step makes every slice but a short
+ * last one whole rows; slices of compressed frames are raw bitstream.
+ *
+ * The callback runs on the libusb event thread, or a replay's thread,
+ * under the constraints uvc_stream_start() lists for
+ * UVC_STREAM_FLAG_INLINE_CALLBACK. Its frame is valid only during the call
+ * and has no capture_time_finished. Slicing is independent of how whole
+ * frames are delivered, which still happens as before, so a frame that
+ * is dropped for lack of a free buffer or as corrupt has already been
+ * sliced. Slicing stops at a payload that could not be stored.
+ *
+ * @param strmh UVC stream, opened but not running
+ * @param cb Slice callback, or NULL to stop slicing
+ * @param user_ptr Passed to @p cb
+ * @param slice_bytes Bytes per slice
+ * @return UVC_ERROR_BUSY if the stream is running, UVC_ERROR_INVALID_PARAM
+ *   if @p cb is given with a @p slice_bytes of 0
+ */
+uvc_error_t uvc_stream_set_slice_callback(uvc_stream_handle_t *strmh,
+    uvc_slice_callback_t *cb, void *user_ptr, size_t slice_bytes) {
+  if (strmh->running)
+    return UVC_ERROR_BUSY;
+
+  if (cb && !slice_bytes)
+    return UVC_ERROR_INVALID_PARAM;
+
+  strmh->slice_cb = cb;
+  strmh->slice_user_ptr = user_ptr;
+  strmh->slice_bytes = slice_bytes;
+  return UVC_SUCCESS;
+}
+
+/** @internal
+ * @brief Sleep until a frame is ready or the stream stops
+ *
+ * Only called by the single frame consumer after ready_bufs came up empty.
+ *
+ * @param timeout_us >0: Wait at most N microseconds; 0: Wait indefinitely
+ * @return false on timeout
+ */
+static bool _uvc_wait_for_frame(uvc_stream_handle_t *strmh, int32_t timeout_us) {
+  std::unique_lock<std::mutex> lock(strmh->callback_mutex);
+  bool ready;
+
+  strmh->frame_waiters.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  auto frame_ready = [&]{return !strmh->running || !strmh->ready_bufs.empty();};
+  if (timeout_us == 0) {
+    strmh->callback_cond.wait(lock, frame_ready);
+    ready = true;
+  } else {
+    ready = strmh->callback_cond.wait_for(
+      lock, std::chrono::microseconds(timeout_us), frame_ready);
+  }
+
+  strmh->frame_waiters.fetch_sub(1, std::memory_order_relaxed);
+  return ready;
+}
+
+/** @internal
+ * @brief Hand a ready frame buffer to user code
+ *
+ * In zero-copy mode the buffer is lent out as is. Otherwise it is copied to
+ * the stream's frame and goes straight back to the free list.
+ */
+static uvc_frame_t *_uvc_deliver_frame(uvc_stream_handle_t *strmh, struct uvc_frame_buffer *fb) {
+  _uvc_count(&strmh->counters.frames_delivered);
+  _uvc_record_latency(strmh->counters.callback_latency_hist,
+                      std::chrono::steady_clock::now() - fb->capture_time_finished);
+
+  if (strmh->flags & UVC_STREAM_FLAG_ZERO_COPY)
+    return _uvc_lend_frame(strmh, fb);
+
+  _uvc_populate_frame(strmh, fb);
+  strmh->free_bufs.push(fb);
+  return &strmh->frame;
+}
+
 /** @internal
  * @brief User callback runner thread
  * @note There should be at most one of these per currently streaming device
@@ -1272,34 +1715,35 @@ uvc_error_t uvc_stream_start_iso(
 void *_uvc_user_caller(void *arg) {
   uvc_stream_handle_t *strmh = (uvc_stream_handle_t *) arg;
 
-  uint32_t last_seq = 0;
+  struct uvc_frame_buffer *fb;
 
   do {
-    {
-      std::unique_lock<std::mutex> lock(strmh->callback_mutex);
+    if (!strmh->running)
+      break;
 
-      strmh->callback_cond.wait(lock, [&]{return !strmh->running || last_seq != strmh->hold_seq;});
+    if (!strmh->ready_bufs.pop(&fb)) {
+      _uvc_wait_for_frame(strmh, 0);
+      continue;
+    }
 
-      if (!strmh->running) {
-        break;
-      }
-    
-      last_seq = strmh->hold_seq;
-      _uvc_populate_frame(strmh);
-    }    
-    
-    strmh->user_cb(&strmh->frame, strmh->user_ptr);
+#ifdef LIBUVC_HAS_JPEG
+    if (strmh->decode) {
+      _uvc_decode_submit(strmh, fb);
+      continue;
+    }
+#endif
+
+    strmh->user_cb(_uvc_deliver_frame(strmh, fb), strmh->user_ptr);
   } while(1);
 
   return NULL; // return value ignored
 }
 
 /** @internal
- * @brief Populate the fields of a frame to be handed to user code
- * must be called with stream cb lock held!
+ * @brief Populate the format and timing fields of a frame from a ready buffer
  */
-void _uvc_populate_frame(uvc_stream_handle_t *strmh) {
-  uvc_frame_t *frame = &strmh->frame;
+void _uvc_populate_frame_info(uvc_stream_handle_t *strmh,
+    struct uvc_frame_buffer *fb, uvc_frame_t *frame) {
   uvc_frame_desc_t *frame_desc;
 
   /** @todo this stuff that hits the main config cache should really happen
@@ -1320,9 +1764,19 @@ void _uvc_populate_frame(uvc_stream_handle_t *strmh) {
     frame->step = frame->width * 3;
     break;
   case UVC_FRAME_FORMAT_YUYV:
+  case UVC_FRAME_FORMAT_UYVY:
+  case UVC_FRAME_FORMAT_GRAY16:
     frame->step = frame->width * 2;
     break;
   case UVC_FRAME_FORMAT_NV12:
+  case UVC_FRAME_FORMAT_I420:
+  case UVC_FRAME_FORMAT_GRAY8:
+  case UVC_FRAME_FORMAT_BY8:
+  case UVC_FRAME_FORMAT_BA81:
+  case UVC_FRAME_FORMAT_SGRBG8:
+  case UVC_FRAME_FORMAT_SGBRG8:
+  case UVC_FRAME_FORMAT_SRGGB8:
+  case UVC_FRAME_FORMAT_SBGGR8:
     frame->step = frame->width;
     break;
   case UVC_FRAME_FORMAT_MJPEG:
@@ -1336,32 +1790,178 @@ void _uvc_populate_frame(uvc_stream_handle_t *strmh) {
     break;
   }
 
-  frame->sequence = strmh->hold_seq;
-  frame->capture_time_finished = strmh->capture_time_finished;
+  frame->sequence = fb->seq;
+  frame->capture_time_finished = fb->capture_time_finished;
+  frame->source = strmh->devh;
+  frame->key_frame = fb->key_frame;
+}
+
+/** @internal
+ * @brief Populate the fields of a frame to be handed to user code
+ *
+ * Copies a ready buffer into the stream's own frame.
+ */
+void _uvc_populate_frame(uvc_stream_handle_t *strmh, struct uvc_frame_buffer *fb) {
+  uvc_frame_t *frame = &strmh->frame;
+
+  _uvc_populate_frame_info(strmh, fb, frame);
 
-  /* copy the image data from the hold buffer to the frame (unnecessary extra buf?) */
-  auto sz = strmh->holdbuf.size();
+  /* copy the image data from the frame buffer to the frame */
+  auto sz = fb->got_bytes;
   if (frame->data_bytes < sz) {
-    frame->data = realloc(frame->data, sz);
+    _uvc_frame_data_free(frame->data);
+    frame->data = _uvc_frame_data_alloc(sz);
   }
   frame->data_bytes = sz;
-  memcpy(frame->data, strmh->holdbuf.data(), sz);
+  memcpy(frame->data, fb->buf + fb->data_offset, sz);
 
-  if (!strmh->meta_holdbuf.empty())
+  if (fb->meta_got_bytes > 0)
   {
-    auto sz = strmh->meta_holdbuf.size();
+    auto sz = fb->meta_got_bytes;
     if (frame->metadata_bytes < sz)
     {
       frame->metadata = realloc(frame->metadata, sz);
     }
     frame->metadata_bytes = sz;
-    memcpy(frame->metadata, strmh->meta_holdbuf.data(), sz);
+    memcpy(frame->metadata, fb->meta_buf, sz);
+  }
+
+  sz = fb->nal_units.size();
+  if (sz > 0) {
+    if (frame->num_nal_units < sz)
+      frame->nal_units = (uvc_nal_unit_t *) realloc(frame->nal_units, sz * sizeof(uvc_nal_unit_t));
+    memcpy(frame->nal_units, fb->nal_units.data(), sz * sizeof(uvc_nal_unit_t));
+  }
+  frame->num_nal_units = sz;
+}
+
+/** @internal
+ * @brief Point a slot's frame at the image the slot holds, without copying
+ */
+static uvc_frame_t *_uvc_frame_view(uvc_stream_handle_t *strmh, struct uvc_frame_buffer *fb) {
+  uvc_frame_t *frame = &fb->frame;
+
+  _uvc_populate_frame_info(strmh, fb, frame);
+
+  /* the buffer belongs to the stream, so conversion functions must not
+   * reallocate or free it */
+  frame->library_owns_data = 0;
+  frame->data = fb->buf + fb->data_offset;
+  frame->data_bytes = fb->got_bytes;
+  if (fb->meta_got_bytes == 0) {
+    frame->metadata = NULL;
+    frame->metadata_bytes = 0;
+  } else {
+    frame->metadata = fb->meta_buf;
+    frame->metadata_bytes = fb->meta_got_bytes;
   }
+  frame->nal_units = fb->nal_units.empty() ? NULL : fb->nal_units.data();
+  frame->num_nal_units = fb->nal_units.size();
+
+  return frame;
+}
+
+/** @internal
+ * @brief Lend a ready frame buffer to user code without copying it
+ *
+ * The returned frame points into the buffer and stays valid until it is
+ * passed to uvc_stream_release_frame().
+ */
+uvc_frame_t *_uvc_lend_frame(uvc_stream_handle_t *strmh, struct uvc_frame_buffer *fb) {
+  uvc_frame_t *frame = _uvc_frame_view(strmh, fb);
+
+  fb->lent.store(1);
+  return frame;
+}
+
+/** Return a frame received in zero-copy mode to the stream
+ * @ingroup streaming
+ *
+ * Frames handed out by a stream started with UVC_STREAM_FLAG_ZERO_COPY point
+ * directly at the stream's buffers. Call this once you are done with such a
+ * frame so the buffer can be reused; it may be called from any thread. The
+ * frame must not be accessed after it has been released, and all frames must
+ * be released before the stream is restarted or closed.
+ *
+ * @param strmh UVC stream
+ * @param frame Frame from the user callback or uvc_stream_get_frame()
+ * @return UVC_ERROR_INVALID_PARAM if the frame is not currently lent out by
+ * this stream
+ */
+uvc_error_t uvc_stream_release_frame(uvc_stream_handle_t *strmh, uvc_frame_t *frame) {
+  auto it = std::find_if(
+    std::begin(strmh->frame_buffers),
+    std::end(strmh->frame_buffers),
+    [&](const std::unique_ptr<struct uvc_frame_buffer>& fb)
+    {
+      return &fb->frame == frame;
+    });
+  if (it == std::end(strmh->frame_buffers))
+    return UVC_ERROR_INVALID_PARAM;
+
+  struct uvc_frame_buffer *fb = it->get();
+  if (!fb->lent.exchange(0))
+    return UVC_ERROR_INVALID_PARAM; /* released twice */
+
+  fb->frame.data = NULL;
+  fb->frame.data_bytes = 0;
+  fb->frame.metadata = NULL;
+  fb->frame.metadata_bytes = 0;
+  fb->frame.nal_units = NULL;
+  fb->frame.num_nal_units = 0;
+  strmh->free_bufs.push(fb);
+
+  return UVC_SUCCESS;
+}
+
+/** Get a stream's statistics
+ * @ingroup streaming
+ *
+ * Counters are maintained whether or not anyone reads them, and reading them
+ * does not block streaming, so this may be called from any thread at any
+ * time, e.g. periodically to detect a degrading camera or link.
+ *
+ * @param strmh UVC stream
+ * @param[out] stats Counters accumulated since the stream was opened
+ */
+uvc_error_t uvc_stream_get_stats(uvc_stream_handle_t *strmh, uvc_stream_stats_t *stats) {
+  const struct uvc_stream_counters *c = &strmh->counters;
+
+  if (!stats)
+    return UVC_ERROR_INVALID_PARAM;
+
+  stats->frames_completed = c->frames_completed.load(std::memory_order_relaxed);
+  stats->frames_delivered = c->frames_delivered.load(std::memory_order_relaxed);
+  stats->frames_dropped = c->frames_dropped.load(std::memory_order_relaxed);
+  stats->fid_resyncs = c->fid_resyncs.load(std::memory_order_relaxed);
+  stats->error_packets = c->error_packets.load(std::memory_order_relaxed);
+  stats->bogus_header_packets = c->bogus_header_packets.load(std::memory_order_relaxed);
+  stats->iso_packet_errors = c->iso_packet_errors.load(std::memory_order_relaxed);
+  stats->transfer_errors = c->transfer_errors.load(std::memory_order_relaxed);
+  stats->resubmit_failures = c->resubmit_failures.load(std::memory_order_relaxed);
+  stats->payload_bytes = c->payload_bytes.load(std::memory_order_relaxed);
+  stats->metadata_bytes = c->metadata_bytes.load(std::memory_order_relaxed);
+  stats->decode_errors = c->decode_errors.load(std::memory_order_relaxed);
+  stats->corrupt_frames = c->corrupt_frames.load(std::memory_order_relaxed);
+  stats->incomplete_frames = c->incomplete_frames.load(std::memory_order_relaxed);
+  for (int i = 0; i < UVC_STREAM_STATS_HISTOGRAM_BUCKETS; ++i) {
+    stats->assembly_latency_hist[i] = c->assembly_latency_hist[i].load(std::memory_order_relaxed);
+    stats->callback_latency_hist[i] = c->callback_latency_hist[i].load(std::memory_order_relaxed);
+  }
+
+  return UVC_SUCCESS;
 }
 
 /** Poll for a frame
  * @ingroup streaming
  *
+ * Frames are returned in the order they were received. Up to
+ * (number of frame buffers - 1) frames are queued for a slow poller before
+ * new frames are dropped. Only one thread may poll a stream at a time.
+ *
+ * In zero-copy mode (UVC_STREAM_FLAG_ZERO_COPY) the returned frame must be
+ * given back with uvc_stream_release_frame().
+ *
  * @param devh UVC device
  * @param[out] frame Location to store pointer to captured frame (NULL on error)
  * @param timeout_us >0: Wait at most N microseconds; 0: Wait indefinitely; -1: return immediately
@@ -1375,38 +1975,27 @@ uvc_error_t uvc_stream_get_frame(uvc_stream_handle_t *strmh,
   if (strmh->user_cb)
     return UVC_ERROR_CALLBACK_EXISTS;
 
-  std::unique_lock<std::mutex> lock(strmh->callback_mutex);
+  struct uvc_frame_buffer *fb;
 
-  if (strmh->last_polled_seq < strmh->hold_seq) {
-    _uvc_populate_frame(strmh);
-    *frame = &strmh->frame;
-    strmh->last_polled_seq = strmh->hold_seq;
-  } else if (timeout_us != -1) {
-    if (timeout_us == 0) {
-      strmh->callback_cond.wait(lock);
-    } else {
-      auto frame_ready = strmh->callback_cond.wait_for(
-        lock, std::chrono::microseconds(timeout_us),
-        [&]{return strmh->last_polled_seq < strmh->hold_seq;});
+  if (!strmh->ready_bufs.pop(&fb)) {
+    if (timeout_us == -1) {
+      *frame = NULL;
+      return UVC_SUCCESS;
+    }
 
-      if (!frame_ready)
-      {
-        *frame = NULL;
-        return UVC_ERROR_TIMEOUT;
-      }
+    if (!_uvc_wait_for_frame(strmh, timeout_us)) {
+      *frame = NULL;
+      return UVC_ERROR_TIMEOUT;
     }
-    
-    if (strmh->last_polled_seq < strmh->hold_seq) {
-      _uvc_populate_frame(strmh);
-      *frame = &strmh->frame;
-      strmh->last_polled_seq = strmh->hold_seq;
-    } else {
+
+    if (!strmh->ready_bufs.pop(&fb)) {
       *frame = NULL;
+      return UVC_SUCCESS;
     }
-  } else {
-    *frame = NULL;
   }
 
+  *frame = _uvc_deliver_frame(strmh, fb);
+
   return UVC_SUCCESS;
 }
 
@@ -1438,6 +2027,9 @@ uvc_error_t uvc_stream_stop(uvc_stream_handle_t *strmh) {
 
   strmh->running = 0;
 
+  if (strmh->replay)
+    _uvc_replay_stop(strmh);
+
   {
     std::unique_lock<std::mutex> lock(strmh->callback_mutex);
 
@@ -1482,7 +2074,7 @@ uvc_error_t uvc_stream_stop(uvc_stream_handle_t *strmh) {
 
   /** @todo stop the actual stream, camera side? */
 
-  if (strmh->user_cb) {
+  if (strmh->callback_thread.joinable()) {
     /* wait for the thread to stop (triggered by
      * LIBUSB_TRANSFER_CANCELLED transfer) */
     UVC_DEBUG("callback_thread joining");
@@ -1490,6 +2082,10 @@ uvc_error_t uvc_stream_stop(uvc_stream_handle_t *strmh) {
     UVC_DEBUG("callback_thread joined");
   }
 
+#ifdef LIBUVC_HAS_JPEG
+  _uvc_decode_stop(strmh);
+#endif
+
   return UVC_SUCCESS;
 }
 
@@ -1504,10 +2100,19 @@ void uvc_stream_close(uvc_stream_handle_t *strmh) {
   if (strmh->running)
     uvc_stream_stop(strmh);
 
+  if (strmh->capture)
+    _uvc_capture_close(strmh->capture);
+
+  if (strmh->replay) {
+    _uvc_replay_close(strmh);
+    return;
+  }
+
   uvc_release_if(strmh->devh, strmh->stream_if->bInterfaceNumber);
 
   if (strmh->frame.data)
-    free(strmh->frame.data);
+    _uvc_frame_data_free(strmh->frame.data);
+  free(strmh->frame.nal_units);
 
   DL_DELETE(strmh->devh->streams, strmh);
   delete strmh;